@@ -29,6 +29,7 @@ LOCAL_C_INCLUDES += external/stlport/stlport/ \
 
 LOCAL_SRC_FILES += \
 	powerdebug.c sensor.c clocks.c regulator.c \
-	display.c tree.c utils.c mainloop.c gpio.c
+	display.c tree.c utils.c mainloop.c gpio.c headless.c bench.c \
+	hash.c snapshot.c energy.c powercap.c thermal.c cpufreq.c cpuidle.c devfreq.c genpd.c runtime_pm.c wakeup.c irq.c suspend.c power_supply.c
 
 include $(BUILD_EXECUTABLE)
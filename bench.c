@@ -0,0 +1,172 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * Display benchmark: the clock panel is rendered against a synthetic
+ * clock tree with the headless backend, as fast as possible, and the
+ * number of frames per second and of allocations per frame is reported.
+ *
+ * The allocations are only counted in the powerdebug-bench binary, built
+ * from this file with BENCH_ALLOC defined, the allocator of powerdebug
+ * itself is never replaced.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "display.h"
+#include "headless.h"
+#include "clocks.h"
+#include "bench.h"
+#include "utils.h"
+
+#define BENCH_NRCLOCKS	1000
+#define BENCH_FANOUT	4
+#define BENCH_WIDTH	160
+#define BENCH_HEIGHT	50
+
+static bool bench_counting;
+static unsigned long bench_nralloc;
+
+#if defined(BENCH_ALLOC) && defined(__GLIBC__)
+#define BENCH_COUNT_ALLOC
+
+/*
+ * Count the allocations by interposing the glibc allocator, the calls
+ * are forwarded to the real implementation, so free and the other entry
+ * points not counted here keep working on the returned blocks. The other
+ * libc will report no allocation count.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size)
+{
+	if (bench_counting)
+		bench_nralloc++;
+
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+	if (bench_counting)
+		bench_nralloc++;
+
+	return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	if (bench_counting)
+		bench_nralloc++;
+
+	return __libc_realloc(ptr, size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+	if (bench_counting)
+		bench_nralloc++;
+
+	return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	return memalign(alignment, size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *ptr;
+
+	if (!alignment || alignment % sizeof(void *) ||
+	    alignment & (alignment - 1))
+		return EINVAL;
+
+	ptr = memalign(alignment, size);
+	if (!ptr)
+		return ENOMEM;
+
+	*memptr = ptr;
+
+	return 0;
+}
+#endif
+
+/*
+ * Run the benchmark and print the result on stdout.
+ *
+ * @nrframes : the number of frames to be rendered
+ * @verbose  : dump the last frame, to be compared with a reference
+ * Returns 0 on success, < 0 otherwise
+ */
+int benchmark(unsigned int nrframes, bool verbose)
+{
+	struct display_backend *backend;
+	uint64_t begin, end;
+	unsigned int i;
+	double elapsed;
+
+	backend = headless_init(BENCH_WIDTH, BENCH_HEIGHT);
+	if (!backend) {
+		fprintf(stderr, "failed to initialize the headless display\n");
+		return -1;
+	}
+
+	if (display_set_backend(backend, CLOCK))
+		return -1;
+
+	if (clock_init_synthetic(BENCH_NRCLOCKS, BENCH_FANOUT)) {
+		fprintf(stderr, "failed to build the synthetic clock tree\n");
+		return -1;
+	}
+
+	bench_nralloc = 0;
+	bench_counting = true;
+	begin = time_monotonic_us();
+
+	for (i = 0; i < nrframes; i++)
+		if (display_draw(CLOCK, false))
+			break;
+
+	end = time_monotonic_us();
+	bench_counting = false;
+
+	if (i < nrframes) {
+		fprintf(stderr, "failed to render frame %u\n", i);
+		return -1;
+	}
+
+	if (verbose)
+		headless_dump(stdout);
+
+	elapsed = (double)(end - begin) / 1000000;
+
+	printf("clocks: %d, frames: %lu, time: %.3f s\n", BENCH_NRCLOCKS,
+	       headless_frames(), elapsed);
+	printf("frames per second: %.1f\n",
+	       elapsed > 0 ? nrframes / elapsed : 0);
+#ifdef BENCH_COUNT_ALLOC
+	printf("allocations per frame: %.1f\n",
+	       nrframes ? (double)bench_nralloc / nrframes : 0);
+#else
+	printf("allocations per frame: n/a\n");
+#endif
+	return 0;
+}
@@ -24,6 +24,7 @@
 #endif
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <sys/param.h>
@@ -34,6 +35,8 @@
 #include "display.h"
 #include "clocks.h"
 #include "tree.h"
+#include "hash.h"
+#include "snapshot.h"
 #include "utils.h"
 
 #ifndef uint
@@ -50,8 +53,67 @@ struct clock_info {
 	int preparecount;
 	int enablecount;
 	int notifiercount;
+	/* activity between two consecutive samples */
+	uint64_t sampled;
+	uint64_t sampled_time;
+	uint64_t enabled_time;
+	double rate_time;
+	int nrratechanges;
+	int nrtransitions;
+	bool watched;
+	/* aggregates of the descendants, updated when a clock changes */
+	int nrenabled;
+	int nrprepared;
+	uint maxrate;
 } *clocks_info;
 
+enum clock_event_type {
+	CLK_EVENT_ENABLE,
+	CLK_EVENT_DISABLE,
+	CLK_EVENT_PREPARE,
+	CLK_EVENT_UNPREPARE,
+	CLK_EVENT_RATE,
+};
+
+static const char *clock_event_name[] = {
+	[CLK_EVENT_ENABLE]    = "enable",
+	[CLK_EVENT_DISABLE]   = "disable",
+	[CLK_EVENT_PREPARE]   = "prepare",
+	[CLK_EVENT_UNPREPARE] = "unprepare",
+	[CLK_EVENT_RATE]      = "rate",
+};
+
+/*
+ * The transitions detected between two samples are kept in a ring
+ * buffer, the oldest events being overwritten.
+ */
+#define CLK_EVENT_MAX 1024
+
+struct clock_event {
+	uint64_t time;
+	struct tree *tree;
+	enum clock_event_type type;
+	uint old;
+	uint new;
+};
+
+static struct clock_event clock_events[CLK_EVENT_MAX];
+static unsigned int clock_nrevents;
+static uint64_t clock_start;
+
+/* The clock panel shows the tree, the event log or the statistics */
+enum clock_view_type {
+	CLK_VIEW_TREE,
+	CLK_VIEW_EVENTS,
+	CLK_VIEW_STATS,
+	CLK_VIEW_MAX,
+};
+
+static int clock_view = CLK_VIEW_TREE;
+
+/* The tree view only shows the subtree of this clock, if any */
+static struct tree *clock_subtree;
+
 enum clock_fw_type{
 	CCF,	/* common clock framework */
 	OCF,	/* old clock framework */
@@ -61,6 +123,27 @@ enum clock_fw_type{
 static struct tree *clock_tree = NULL;
 static int clock_fw;
 
+/*
+ * With the common clock framework, the state of all the clocks is
+ * summarized in a single debugfs file. When it is available, this file
+ * is read once per refresh and the clocks are found by name, instead of
+ * opening the files of each clock. The directory tree is only used for
+ * the topology and the flags.
+ */
+static char *clk_summary_path;
+static char *clk_summary_buf;
+static size_t clk_summary_size;
+static struct hash *clock_hash;
+
+/*
+ * In lazy mode, the subtrees are loaded when their parent is expanded
+ * the first time and a refresh only reads the visible clocks and the
+ * ones explicitly watched.
+ */
+static bool clock_lazy;
+static struct tree **clock_watched;
+static int clock_nrwatched;
+
 static int locate_debugfs(char *clk_path)
 {
 	strcpy(clk_path, "/sys/kernel/debug");
@@ -179,9 +262,146 @@ static int dump_all_parents(char *clkarg)
 	return tree_for_each_parent(tree, dump_clock_cb, NULL);
 }
 
+static void clock_add_event(uint64_t time, struct tree *t,
+			    enum clock_event_type type, uint old, uint new)
+{
+	struct clock_event *event;
+
+	event = &clock_events[clock_nrevents++ % CLK_EVENT_MAX];
+	event->time = time;
+	event->tree = t;
+	event->type = type;
+	event->old = old;
+	event->new = new;
+}
+
+static inline int clock_is_enabled(struct clock_info *clk)
+{
+	return (clock_fw == CCF ? clk->enablecount : clk->usecount) > 0;
+}
+
+static inline uint clock_subtree_rate(struct clock_info *clk, uint rate)
+{
+	return rate > clk->maxrate ? rate : clk->maxrate;
+}
+
+/*
+ * The maximum rate of the children of a clock, only computed when the
+ * clock which had the maximum rate is lowered.
+ */
+static uint clock_children_maxrate(struct tree *t)
+{
+	struct clock_info *clk;
+	uint rate, maxrate = 0;
+
+	for (t = t->child; t; t = t->next) {
+		clk = t->private;
+		rate = clock_subtree_rate(clk, clk->rate);
+		if (rate > maxrate)
+			maxrate = rate;
+	}
+
+	return maxrate;
+}
+
+/*
+ * Update the aggregates of the parents of a clock which changed. Only
+ * the difference with the previous sample is propagated and the walk
+ * stops as soon as a parent is left unchanged, so the cost depends on
+ * the number of changed clocks and their depth, not on the tree size.
+ *
+ * @t   : the clock node, its private data holds the new sample
+ * @old : the previous sample
+ */
+static void clock_propagate(struct tree *t, struct clock_info *old)
+{
+	struct clock_info *clk = t->private, *pclk;
+	struct tree *parent;
+	int enabled, prepared;
+	uint oldrate, newrate, maxrate;
+
+	enabled = clock_is_enabled(clk) - clock_is_enabled(old);
+	prepared = (clk->preparecount > 0) - (old->preparecount > 0);
+
+	for (parent = t->parent; parent && (enabled || prepared);
+	     parent = parent->parent) {
+		pclk = parent->private;
+		pclk->nrenabled += enabled;
+		pclk->nrprepared += prepared;
+	}
+
+	/* the maximum rate of the subtree of the clock before and after */
+	oldrate = clock_subtree_rate(clk, old->rate);
+	newrate = clock_subtree_rate(clk, clk->rate);
+
+	for (parent = t->parent; parent && oldrate != newrate;
+	     parent = parent->parent) {
+		pclk = parent->private;
+		maxrate = pclk->maxrate;
+
+		if (newrate > maxrate)
+			pclk->maxrate = newrate;
+		else if (oldrate == maxrate)
+			pclk->maxrate = clock_children_maxrate(parent);
+
+		oldrate = maxrate > pclk->rate ? maxrate : pclk->rate;
+		newrate = clock_subtree_rate(pclk, pclk->rate);
+	}
+}
+
+/*
+ * Compare the new sample of a clock with the previous one, log the
+ * transitions and update the statistics. The previous state is assumed
+ * to have lasted for the whole interval between the two samples.
+ *
+ * @t   : the clock node, its private data holds the new sample
+ * @old : the previous sample
+ * @now : the time of the new sample
+ */
+static void clock_account(struct tree *t, struct clock_info *old, uint64_t now)
+{
+	struct clock_info *clk = t->private;
+	uint64_t delta;
+	int enabled, wasenabled;
+
+	if (!clk->sampled) {
+		clk->sampled = now;
+		return;
+	}
+
+	delta = now - clk->sampled;
+	clk->sampled = now;
+	clk->sampled_time += delta;
+	clk->rate_time += (double)old->rate * delta;
+
+	wasenabled = clock_is_enabled(old);
+	enabled = clock_is_enabled(clk);
+
+	if (wasenabled)
+		clk->enabled_time += delta;
+
+	if (enabled != wasenabled) {
+		clock_add_event(now, t, enabled ? CLK_EVENT_ENABLE :
+				CLK_EVENT_DISABLE, wasenabled, enabled);
+		clk->nrtransitions++;
+	}
+
+	if ((clk->preparecount > 0) != (old->preparecount > 0))
+		clock_add_event(now, t, clk->preparecount > 0 ?
+				CLK_EVENT_PREPARE : CLK_EVENT_UNPREPARE,
+				old->preparecount, clk->preparecount);
+
+	if (clk->rate != old->rate) {
+		clock_add_event(now, t, CLK_EVENT_RATE, old->rate, clk->rate);
+		clk->nrratechanges++;
+	}
+}
+
 static inline int read_clock_cb(struct tree *t, void *data)
 {
 	struct clock_info *clk = t->private;
+	struct clock_info old = *clk;
+	uint64_t *now = data;
 
 	if(clock_fw == CCF) {
 		file_read_value(t->path, "clk_flags", "%x", &clk->flags);
@@ -196,12 +416,172 @@ static inline int read_clock_cb(struct tree *t, void *data)
 		file_read_value(t->path, "usecount", "%d", &clk->usecount);
 	}
 
+	if (t->parent)
+		clock_propagate(t, &old);
+
+	if (now && t->parent)
+		clock_account(t, &old, *now);
+
+	return 0;
+}
+
+/*
+ * Parse the clk_summary content in a single pass. The lines before the
+ * dashed separator are the column names, the old kernels do not have
+ * the 'protect' column. The lines which do not begin with a clock name
+ * followed by the counters, as the consumer lines, are ignored.
+ *
+ * @buf : the nul terminated file content, modified by the parsing
+ * @now : the time of the sample
+ * Returns the number of clocks updated
+ */
+static int clock_summary_parse(char *buf, uint64_t now)
+{
+	char *line, *eol, *p, *name;
+	unsigned long values[4];
+	struct clock_info *clk, old;
+	struct tree *t;
+	bool header = true, protect = false;
+	int i, nrvalues, nr = 0;
+	size_t len;
+
+	for (line = buf; *line; line = eol) {
+
+		eol = strchr(line, '\n');
+		if (eol)
+			*eol++ = '\0';
+		else
+			eol = line + strlen(line);
+
+		for (p = line; *p == ' ' || *p == '\t'; p++)
+			;
+
+		if (header) {
+			if (strstr(line, "protect"))
+				protect = true;
+			if (*p == '-')
+				header = false;
+			continue;
+		}
+
+		name = p;
+		while (*p && *p != ' ' && *p != '\t')
+			p++;
+		len = p - name;
+
+		if (!len)
+			continue;
+
+		nrvalues = protect ? 4 : 3;
+
+		for (i = 0; i < nrvalues; i++) {
+			while (*p == ' ' || *p == '\t')
+				p++;
+			if (*p < '0' || *p > '9')
+				break;
+			values[i] = strtoul(p, &p, 10);
+		}
+
+		if (i < nrvalues)
+			continue;
+
+		t = hash_find(clock_hash, name, len);
+		if (!t)
+			continue;
+
+		clk = t->private;
+		old = *clk;
+
+		clk->enablecount = values[0];
+		clk->preparecount = values[1];
+		clk->rate = values[nrvalues - 1];
+
+		clock_propagate(t, &old);
+		clock_account(t, &old, now);
+		nr++;
+	}
+
+	return nr;
+}
+
+/*
+ * Use the summary file if it is present in the clock directory.
+ * Returns 0 on success or if there is no summary, < 0 otherwise
+ */
+static int clock_summary_init(const char *path)
+{
+	if (asprintf(&clk_summary_path, "%s/clk_summary", path) < 0) {
+		clk_summary_path = NULL;
+		return -1;
+	}
+
+	if (access(clk_summary_path, R_OK)) {
+		free(clk_summary_path);
+		clk_summary_path = NULL;
+		return 0;
+	}
+
+	clock_hash = hash_create(clock_tree->nrchild);
+	if (!clock_hash)
+		return -1;
+
+	return 0;
+}
+
+static int read_clock_summary(uint64_t now)
+{
+	if (file_read_buffer(clk_summary_path, &clk_summary_buf,
+			     &clk_summary_size) < 0)
+		return -1;
+
+	return clock_summary_parse(clk_summary_buf, now) ? 0 : -1;
+}
+
+static int is_collapsed(struct tree *t, void *data);
+
+/*
+ * Read the clocks of a list and the children of the expanded ones.
+ */
+static int read_clock_visible(struct tree *t, uint64_t *now)
+{
+	struct clock_info *clk;
+
+	for (; t; t = t->next) {
+
+		if (read_clock_cb(t, now))
+			return -1;
+
+		clk = t->private;
+		if (clk->expanded && read_clock_visible(t->child, now))
+			return -1;
+	}
+
 	return 0;
 }
 
 static int read_clock_info(struct tree *tree)
 {
-	return tree_for_each(tree, read_clock_cb, NULL);
+	uint64_t now = time_monotonic_us();
+	int i;
+
+	/* fallback to the per clock files if the summary is unusable */
+	if (clk_summary_path && !read_clock_summary(now))
+		return 0;
+
+	if (!clock_lazy)
+		return tree_for_each(tree, read_clock_cb, &now);
+
+	if (read_clock_visible(tree, &now))
+		return -1;
+
+	/* the watched clocks hidden by a collapsed parent */
+	for (i = 0; i < clock_nrwatched; i++)
+		if (tree_for_each_parent(clock_watched[i]->parent,
+					 is_collapsed, NULL) &&
+		    read_clock_cb(clock_watched[i], &now))
+			return -1;
+
+	return 0;
 }
 
 static int fill_clock_cb(struct tree *t, void *data)
@@ -219,12 +599,32 @@ static int fill_clock_cb(struct tree *t, void *data)
 		return 0;
 	}
 
+	/* the other values are read from the summary */
+	if (clk_summary_path) {
+		file_read_value(t->path, "clk_flags", "%x", &clk->flags);
+		file_read_value(t->path, "clk_notifier_count", "%d",
+				&clk->notifiercount);
+		return hash_add(clock_hash, t->name, t);
+	}
+
 	return read_clock_cb(t, data);
 }
 
 static int fill_clock_tree(void)
 {
-	return tree_for_each(clock_tree, fill_clock_cb, NULL);
+	clock_start = time_monotonic_us();
+
+	if (tree_for_each(clock_tree, fill_clock_cb, &clock_start))
+		return -1;
+
+	if (clk_summary_path && read_clock_summary(clock_start)) {
+		/* the summary can't be parsed, use the per clock files */
+		free(clk_summary_path);
+		clk_summary_path = NULL;
+		return read_clock_info(clock_tree);
+	}
+
+	return 0;
 }
 
 static int is_collapsed(struct tree *t, void *data)
@@ -242,30 +642,41 @@ static char *clock_line(struct tree *t)
 	struct clock_info *clk;
 	uint rate;
 	const char *clkunit;
-	char *clkrate, *clkname, *clkline = NULL;
+	char *clkrate, *maxrate, *clkname, *clkline = NULL;
 
 	clk = t->private;
 	rate = clk->rate;
 	clkunit = clock_rate(&rate);
 
-	if (asprintf(&clkname, "%*s%s", (t->depth - 1) * 2, "", t->name) < 0)
+	if (asprintf(&clkname, "%*s%s%s", (t->depth - 1) * 2, "", t->name,
+		     clk->watched ? "*" : "") < 0)
 		return NULL;
 
 	if (asprintf(&clkrate, "%d%s", rate, clkunit) < 0)
 		goto free_clkname;
 
+	rate = clk->maxrate;
+	clkunit = clock_rate(&rate);
+
+	if (asprintf(&maxrate, "%d%s", rate, clkunit) < 0)
+		goto free_clkrate;
+
 	if(clock_fw == CCF) {
-		if (asprintf(&clkline, "%-35s 0x%-8x %-12s %-10d %-11d %-15d %-14d %-10d",
+		if (asprintf(&clkline, "%-35s 0x%-8x %-12s %-10d %-11d %-15d %-14d %-14d %-11d %-12d %-12s",
 			     clkname, clk->flags, clkrate, clk->usecount, t->nrchild,
-			     clk->preparecount, clk->enablecount, clk->notifiercount) < 0)
-			goto free_clkrate;
+			     clk->preparecount, clk->enablecount, clk->notifiercount,
+			     clk->nrenabled, clk->nrprepared, maxrate) < 0)
+			goto free_maxrate;
 	}
 	else {
-		if (asprintf(&clkline, "%-55s 0x%-16x %-12s %-9d %-8d",
-			     clkname, clk->flags, clkrate, clk->usecount, t->nrchild) < 0)
-			goto free_clkrate;
+		if (asprintf(&clkline, "%-55s 0x%-16x %-12s %-9d %-8d %-11d %-12s",
+			     clkname, clk->flags, clkrate, clk->usecount, t->nrchild,
+			     clk->nrenabled, maxrate) < 0)
+			goto free_maxrate;
 	}
 
+free_maxrate:
+	free(maxrate);
 free_clkrate:
 	free(clkrate);
 free_clkname:
@@ -297,33 +708,22 @@ static int _clock_print_info_cb(struct tree *t, void *data)
 	return 0;
 }
 
-static int clock_print_info_cb(struct tree *t, void *data)
-{
-        /* we skip the root node of the tree */
-	if (!t->parent)
-		return 0;
-
-        /* show the clock when *all* its parent is expanded */
-	if (tree_for_each_parent(t->parent, is_collapsed, NULL))
-		return 0;
-
-	return _clock_print_info_cb(t, data);
-}
-
 static int clock_print_header(void)
 {
 	char *buf;
 	int ret;
 
 	if(clock_fw == CCF) {
-		if (asprintf(&buf, "%-35s %-10s %-12s %-10s %-11s %-15s %-14s %-14s",
+		if (asprintf(&buf, "%-35s %-10s %-12s %-10s %-11s %-15s %-14s %-14s %-11s %-12s %-12s",
 		     "Name", "Flags", "Rate", "Usecount", "Children", "Prepare_Count",
-		     "Enable_Count", "Notifier_Count") < 0)
+		     "Enable_Count", "Notifier_Count", "Sub_Enabled",
+		     "Sub_Prepared", "Sub_Max_Rate") < 0)
 		return -1;
 	}
 	else {
-		if (asprintf(&buf, "%-55s %-16s %-12s %-9s %-8s",
-		     "Name", "Flags", "Rate", "Usecount", "Children") < 0)
+		if (asprintf(&buf, "%-55s %-16s %-12s %-9s %-8s %-11s %-12s",
+		     "Name", "Flags", "Rate", "Usecount", "Children",
+		     "Sub_Enabled", "Sub_Max_Rate") < 0)
 		return -1;
 	}
 
@@ -334,6 +734,16 @@ static int clock_print_header(void)
 	return ret;
 }
 
+static bool clock_is_collapsed(struct tree *t)
+{
+	struct clock_info *clk = t->private;
+
+	return !clk->expanded;
+}
+
+/*
+ * Show the clocks of a subtree whose parents are expanded
+ */
 static int clock_print_info(struct tree *tree)
 {
 	int ret, line = 0;
@@ -342,10 +752,162 @@ static int clock_print_info(struct tree *tree)
 
 	clock_print_header();
 
-	ret = tree_for_each(tree, clock_print_info_cb, &line);
+	ret = tree_for_each_visible(tree, clock_is_collapsed,
+				    _clock_print_info_cb, &line);
+
+	display_refresh_pad(CLOCK);
+
+	return ret;
+}
+
+static int clock_count_cb(struct tree *t, void *data)
+{
+	int *nr = data;
+
+	if (t->parent)
+		(*nr)++;
+
+	return 0;
+}
+
+static int clock_print_events(void)
+{
+	struct clock_event *event;
+	unsigned int i, nrevents;
+	uint old, new;
+	const char *oldunit, *newunit;
+	char *buf;
+	int line = 0;
+
+	display_reset_cursor(CLOCK);
+
+	if (asprintf(&buf, "%-12s %-35s %-10s %s",
+		     "Time", "Name", "Event", "Transition") < 0)
+		return -1;
+	display_column_name(buf);
+	free(buf);
+
+	nrevents = clock_nrevents < CLK_EVENT_MAX ?
+		clock_nrevents : CLK_EVENT_MAX;
+
+	/* the most recent events first */
+	for (i = 0; i < nrevents; i++) {
+
+		event = &clock_events[(clock_nrevents - 1 - i) % CLK_EVENT_MAX];
+		old = event->old;
+		new = event->new;
+
+		if (event->type == CLK_EVENT_RATE) {
+			oldunit = clock_rate(&old);
+			newunit = clock_rate(&new);
+		} else
+			oldunit = newunit = "";
+
+		if (asprintf(&buf, "%-12.3f %-35s %-10s %u%s -> %u%s",
+			     (double)(event->time - clock_start) / 1000000,
+			     event->tree->name, clock_event_name[event->type],
+			     old, oldunit, new, newunit) < 0)
+			return -1;
+
+		display_print_line(CLOCK, line++, buf,
+				   event->type == CLK_EVENT_ENABLE, event->tree);
+		free(buf);
+	}
+
+	return display_refresh_pad(CLOCK);
+}
+
+static int clock_stats_collect_cb(struct tree *t, void *data)
+{
+	struct tree ***ptree = data;
+
+	if (!t->parent)
+		return 0;
+
+	*((*ptree)++) = t;
+
+	return 0;
+}
+
+static int clock_stats_cmp(const void *a, const void *b)
+{
+	struct clock_info *clka = (*(struct tree **)a)->private;
+	struct clock_info *clkb = (*(struct tree **)b)->private;
+	double ra, rb;
+
+	ra = clka->sampled_time ?
+		(double)clka->enabled_time / clka->sampled_time : 0;
+	rb = clkb->sampled_time ?
+		(double)clkb->enabled_time / clkb->sampled_time : 0;
+
+	if (ra != rb)
+		return ra < rb ? 1 : -1;
+
+	return clkb->nrtransitions - clka->nrtransitions;
+}
+
+/*
+ * Show the clocks sorted by the percentage of the time they have been
+ * enabled, the ones which stay enabled come first.
+ */
+static int clock_print_stats(void)
+{
+	struct tree **ptree, **p;
+	struct clock_info *clk;
+	int i, nr, line = 0, ret = 0;
+	uint avgrate;
+	const char *unit;
+	char *buf;
+
+	nr = 0;
+	tree_for_each(clock_tree, clock_count_cb, &nr);
+
+	ptree = malloc(sizeof(*ptree) * (nr ? nr : 1));
+	if (!ptree)
+		return -1;
+
+	p = ptree;
+	tree_for_each(clock_tree, clock_stats_collect_cb, &p);
+
+	qsort(ptree, nr, sizeof(*ptree), clock_stats_cmp);
+
+	display_reset_cursor(CLOCK);
+
+	if (asprintf(&buf, "%-35s %-10s %-12s %-12s %-14s",
+		     "Name", "Enabled", "Transitions", "Rate_Changes",
+		     "Average_Rate") < 0) {
+		free(ptree);
+		return -1;
+	}
+	display_column_name(buf);
+	free(buf);
+
+	for (i = 0; i < nr; i++) {
+
+		clk = ptree[i]->private;
+
+		avgrate = clk->sampled_time ?
+			clk->rate_time / clk->sampled_time : clk->rate;
+		unit = clock_rate(&avgrate);
+
+		if (asprintf(&buf, "%-35s %-9.1f%% %-12d %-12d %u%s",
+			     ptree[i]->name, clk->sampled_time ?
+			     100. * clk->enabled_time / clk->sampled_time : 0,
+			     clk->nrtransitions, clk->nrratechanges,
+			     avgrate, unit) < 0) {
+			ret = -1;
+			break;
+		}
+
+		display_print_line(CLOCK, line++, buf,
+				   clock_is_enabled(clk), ptree[i]);
+		free(buf);
+	}
 
 	display_refresh_pad(CLOCK);
 
+	free(ptree);
+
 	return ret;
 }
 
@@ -354,8 +916,24 @@ static int clock_select(void)
 	struct tree *t = display_get_row_data(CLOCK);
 	struct clock_info *clk = t->private;
 
+	if (clock_view != CLK_VIEW_TREE)
+		return 0;
+
 	clk->expanded = !clk->expanded;
 
+	/* load the children the first time the clock is expanded */
+	if (clock_lazy && clk->expanded && !t->loaded) {
+
+		if (tree_expand(t, NULL, false))
+			return -1;
+
+		if (tree_for_each(t->child, fill_clock_cb, &clock_start))
+			return -1;
+
+		if (clk_summary_path)
+			read_clock_summary(time_monotonic_us());
+	}
+
 	return 0;
 }
 
@@ -369,7 +947,68 @@ static int clock_display(bool refresh)
 	if (refresh && read_clock_info(clock_tree))
 		return -1;
 
-	return clock_print_info(clock_tree);
+	switch (clock_view) {
+	case CLK_VIEW_EVENTS:
+		return clock_print_events();
+	case CLK_VIEW_STATS:
+		return clock_print_stats();
+	}
+
+	return clock_print_info(clock_subtree ? clock_subtree : clock_tree);
+}
+
+static int clock_watch(struct tree *t)
+{
+	struct clock_info *clk = t->private;
+	struct tree **watched;
+	int i;
+
+	clk->watched = !clk->watched;
+
+	if (!clk->watched) {
+		for (i = 0; i < clock_nrwatched; i++)
+			if (clock_watched[i] == t)
+				break;
+		if (i < clock_nrwatched)
+			clock_watched[i] = clock_watched[--clock_nrwatched];
+		return 0;
+	}
+
+	watched = realloc(clock_watched,
+			  sizeof(*watched) * (clock_nrwatched + 1));
+	if (!watched)
+		return -1;
+
+	clock_watched = watched;
+	clock_watched[clock_nrwatched++] = t;
+
+	return 0;
+}
+
+/*
+ * The 'E' key switches between the clock tree, the log of the clock
+ * transitions and the per clock statistics. The 'W' key marks the
+ * selected clock as watched, it is read even when it is not showed.
+ * The 'F' key restricts the tree to the subtree of the selected clock,
+ * or shows the whole tree again.
+ */
+static int clock_change(int keyvalue)
+{
+	switch (keyvalue) {
+	case 'E':
+		clock_view = (clock_view + 1) % CLK_VIEW_MAX;
+		break;
+	case 'W':
+		return clock_watch(display_get_row_data(CLOCK));
+	case 'F':
+		if (clock_view != CLK_VIEW_TREE)
+			break;
+		clock_subtree = clock_subtree ? NULL :
+			display_get_row_data(CLOCK);
+		break;
+	}
+
+	return 0;
 }
 
 static int clock_find(const char *name)
@@ -436,13 +1075,211 @@ int clock_dump(char *clk)
 	return ret;
 }
 
+static int dump_subtree_cb(struct tree *t, int depth)
+{
+	struct clock_info *clk = t->private;
+	const char *unit;
+	uint rate = clk->rate;
+
+	unit = clock_rate(&rate);
+
+	if (clock_fw == CCF)
+		printf("%*s%s (flags:0x%x, rate: %u %s, prepare_count:%d, "
+		       "enable_count:%d)\n", depth * 3, "", t->name,
+		       clk->flags, rate, unit, clk->preparecount,
+		       clk->enablecount);
+	else
+		printf("%*s%s (flags:0x%x, usecount:%d, rate: %u %s)\n",
+		       depth * 3, "", t->name, clk->flags, clk->usecount,
+		       rate, unit);
+
+	return 0;
+}
+
+/*
+ * Dump the clocks of the subtree of a clock and count the enabled and
+ * prepared ones, the subtree being contiguous in the tree order.
+ * @clk : the name of the topmost clock of the subtree
+ * Return 0 on success, < 0 otherwise
+ */
+int clock_dump_subtree(const char *clk)
+{
+	struct tree **nodes, *tree;
+	struct clock_info *ci;
+	int i, nr, nrenabled = 0, nrprepared = 0;
+
+	if (read_clock_info(clock_tree))
+		return -1;
+
+	tree = tree_find(clock_tree, clk);
+	if (!tree) {
+		printf("Clock NOT found!\n");
+		return -1;
+	}
+
+	nr = tree_subtree(tree, &nodes);
+
+	printf("\nSubtree of \"%s\" Clock :\n\n", clk);
+
+	for (i = 0; i < nr; i++) {
+
+		ci = nodes[i]->private;
+
+		if (clock_is_enabled(ci))
+			nrenabled++;
+
+		if (ci->preparecount > 0)
+			nrprepared++;
+
+		dump_subtree_cb(nodes[i], nodes[i]->depth - tree->depth);
+	}
+
+	printf("\n%d clocks, %d enabled", nr, nrenabled);
+	if (clock_fw == CCF)
+		printf(", %d prepared", nrprepared);
+	printf("\n\n");
+
+	return 0;
+}
+
+/*
+ * Find the lowest common parent of two clocks.
+ * Return 0 on success, < 0 otherwise
+ */
+int clock_dump_lca(const char *clk1, const char *clk2)
+{
+	struct tree *t1, *t2, *lca;
+
+	t1 = tree_find(clock_tree, clk1);
+	t2 = tree_find(clock_tree, clk2);
+	if (!t1 || !t2) {
+		printf("Clock NOT found!\n");
+		return -1;
+	}
+
+	lca = tree_lca(t1, t2);
+
+	printf("\nCommon parent of \"%s\" and \"%s\" Clocks : %s\n\n",
+	       clk1, clk2, lca && lca->parent ? lca->name : "none");
+
+	return 0;
+}
+
+static int clock_snapshot_cb(struct tree *t, void *data)
+{
+	struct snapshot *snap = data;
+	struct clock_info *clk = t->private;
+
+	if (!t->parent)
+		return 0;
+
+	if (snapshot_node(snap, t->path) ||
+	    snapshot_int(snap, "flags", clk->flags) ||
+	    snapshot_int(snap, "rate", clk->rate))
+		return -1;
+
+	if (clock_fw != CCF)
+		return snapshot_int(snap, "usecount", clk->usecount);
+
+	if (snapshot_int(snap, "prepare_count", clk->preparecount) ||
+	    snapshot_int(snap, "enable_count", clk->enablecount) ||
+	    snapshot_int(snap, "notifier_count", clk->notifiercount))
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Read the clock information and add the clocks to a snapshot.
+ * Return 0 on success, < 0 otherwise
+ */
+int clock_snapshot(struct snapshot *snap)
+{
+	if (read_clock_info(clock_tree))
+		return -1;
+
+	return tree_for_each(clock_tree, clock_snapshot_cb, snap);
+}
+
 static struct display_ops clock_ops = {
 	.display = clock_display,
 	.select  = clock_select,
 	.find    = clock_find,
 	.selectf = clock_selectf,
+	.change  = clock_change,
 };
 
+/*
+ * Build a synthetic common clock framework tree in memory, the clocks
+ * have 'fanout' children until 'nrclocks' clocks are created. This is
+ * used to benchmark the display independently of the debugfs content.
+ *
+ * @nrclocks : the number of clocks of the tree
+ * @fanout   : the number of children per clock
+ * Returns 0 on success, < 0 otherwise
+ */
+int clock_init_synthetic(unsigned int nrclocks, unsigned int fanout)
+{
+	struct tree **nodes;
+	struct clock_info *clk, old;
+	char name[NAME_MAX];
+	unsigned int i;
+	int ret = -1;
+
+	if (!fanout)
+		return -1;
+
+	clock_fw = CCF;
+
+	nodes = malloc(sizeof(*nodes) * (nrclocks + 1));
+	if (!nodes)
+		return -1;
+
+	clock_tree = tree_add_node(NULL, "clk");
+	if (!clock_tree)
+		goto out_free;
+	nodes[0] = clock_tree;
+
+	for (i = 1; i <= nrclocks; i++) {
+
+		snprintf(name, sizeof(name), "clk_synthetic_%u", i);
+
+		nodes[i] = tree_add_node(nodes[(i - 1) / fanout], name);
+		if (!nodes[i])
+			goto out_free;
+	}
+
+	if (fill_clock_tree())
+		goto out_free;
+
+	if (tree_index(clock_tree))
+		goto out_free;
+
+	for (i = 0; i <= nrclocks; i++) {
+		clk = nodes[i]->private;
+		old = *clk;
+		clk->expanded = true;
+		clk->rate = 32768 << (i % 16);
+		clk->preparecount = i % 3;
+		clk->enablecount = i % 2;
+		clk->usecount = clk->enablecount;
+		clock_propagate(nodes[i], &old);
+	}
+
+	ret = display_register(CLOCK, &clock_ops);
+out_free:
+	free(nodes);
+	return ret;
+}
+
+/*
+ * Enable the lazy mode, must be called before clock_init
+ */
+void clock_set_lazy(bool lazy)
+{
+	clock_lazy = lazy;
+}
+
 /*
  * Initialize the clock framework
  */
@@ -466,10 +1303,15 @@ int clock_init(void)
 	else
 		return -1;
 
-	clock_tree = tree_load(clk_dir_path[MAX], NULL, false);
+	clock_tree = clock_lazy ?
+		tree_load_lazy(clk_dir_path[MAX], NULL, false) :
+		tree_load(clk_dir_path[MAX], NULL, false);
 	if (!clock_tree)
 		return -1;
 
+	if (clock_fw == CCF && clock_summary_init(clk_dir_path[CCF]))
+		return -1;
+
 	if (fill_clock_tree())
 		return -1;
 
@@ -13,5 +13,12 @@
  *       - initial API and implementation
  *******************************************************************************/
 
+struct snapshot;
+
 extern int clock_init(void);
+extern void clock_set_lazy(bool lazy);
 extern int clock_dump(char *clk);
+extern int clock_dump_subtree(const char *clk);
+extern int clock_dump_lca(const char *clk1, const char *clk2);
+extern int clock_snapshot(struct snapshot *snap);
+extern int clock_init_synthetic(unsigned int nrclocks, unsigned int fanout);
@@ -0,0 +1,438 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * The cpufreq policies with the residency in each frequency and the
+ * transitions between them. The frequencies of a policy are found once,
+ * the statistics files are kept opened and parsed in a reused buffer
+ * into arrays indexed by frequency, the deltas between two refreshes
+ * being computed array wide.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#undef _GNU_SOURCE
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "powerdebug.h"
+#include "display.h"
+#include "cpufreq.h"
+#include "tree.h"
+#include "snapshot.h"
+#include "utils.h"
+
+#define SYSFS_CPUFREQ "/sys/devices/system/cpu/cpufreq"
+
+/*
+ * A cpufreq policy, the statistics are in arrays of nrfreqs entries and
+ * the transitions in a nrfreqs x nrfreqs matrix, from row to column.
+ *
+ * time  : the time spent in each frequency, in 10ms units
+ * trans : the number of transitions between two frequencies
+ * ptime, ptrans : the previous values of time and trans
+ * dtime : the time spent in the last interval
+ * dtrans: the transitions of the last interval, from each frequency
+ */
+struct cpufreq_policy {
+	char cpus[NAME_MAX];
+	char governor[32];
+	int fd_cur;
+	int fd_time;
+	int fd_trans;
+	long long cur;
+	int nrfreqs;
+	uint64_t *freqs;
+	uint64_t *time;
+	uint64_t *trans;
+	uint64_t *ptime;
+	uint64_t *ptrans;
+	uint64_t *dtime;
+	uint64_t *dtrans;
+	uint64_t total;
+	uint64_t dtotal;
+	uint64_t sampled;
+	uint64_t interval;
+	bool sampled_once;
+};
+
+static struct tree *cpufreq_tree;
+static bool cpufreq_error = false;
+
+/* reused to read the statistics files of all the policies */
+static char *cpufreq_buf;
+static size_t cpufreq_size;
+
+static const char * const cpufreq_shape[] = { "policy*", NULL };
+
+/*
+ * Parse the time_in_state content, a frequency and a time per line, in
+ * the order found at init.
+ * Returns the number of frequencies parsed
+ */
+static int cpufreq_parse_time(char *buf, uint64_t *freqs, uint64_t *time,
+			      int nrfreqs)
+{
+	char *p = buf;
+	int i;
+
+	for (i = 0; i < nrfreqs && *p; i++) {
+		freqs[i] = strtoull(p, &p, 10);
+		time[i] = strtoull(p, &p, 10);
+		while (*p == '\n')
+			p++;
+	}
+
+	return i;
+}
+
+/*
+ * Parse the trans_table content: two header lines then a line per
+ * frequency, the frequency followed by ':' and the transitions to each
+ * frequency.
+ */
+static void cpufreq_parse_trans(char *buf, uint64_t *trans, int nrfreqs)
+{
+	char *p;
+	int i, j;
+
+	p = strchr(buf, '\n');
+	if (p)
+		p = strchr(p + 1, '\n');
+
+	for (i = 0; p && i < nrfreqs; i++) {
+
+		p = strchr(p, ':');
+		if (!p)
+			break;
+		p++;
+
+		for (j = 0; j < nrfreqs; j++)
+			trans[i * nrfreqs + j] = strtoull(p, &p, 10);
+	}
+}
+
+static int read_cpufreq_cb(struct tree *t, void *data)
+{
+	struct cpufreq_policy *policy = t->private;
+	uint64_t *now = data;
+	int i, j, n = policy->nrfreqs;
+	uint64_t dtotal = 0, sum;
+
+	if (!t->parent)
+		return 0;
+
+	if (policy->fd_cur >= 0)
+		fd_read_value(policy->fd_cur, &policy->cur);
+
+	if (!n)
+		return 0;
+
+	memcpy(policy->ptime, policy->time, sizeof(*policy->time) * n);
+	memcpy(policy->ptrans, policy->trans, sizeof(*policy->trans) * n * n);
+
+	if (fd_read_buffer(policy->fd_time, &cpufreq_buf,
+			   &cpufreq_size) > 0)
+		cpufreq_parse_time(cpufreq_buf, policy->freqs, policy->time, n);
+
+	if (policy->fd_trans >= 0 &&
+	    fd_read_buffer(policy->fd_trans, &cpufreq_buf,
+			   &cpufreq_size) > 0)
+		cpufreq_parse_trans(cpufreq_buf, policy->trans, n);
+
+	/* the deltas of the whole arrays, the first sample has none */
+	if (policy->sampled_once) {
+
+		for (i = 0; i < n; i++)
+			policy->dtime[i] = policy->time[i] - policy->ptime[i];
+
+		for (i = 0; i < n; i++)
+			dtotal += policy->dtime[i];
+
+		for (i = 0; i < n; i++) {
+			sum = 0;
+			for (j = 0; j < n; j++)
+				sum += policy->trans[i * n + j] -
+					policy->ptrans[i * n + j];
+			policy->dtrans[i] = sum;
+		}
+
+		policy->interval = *now - policy->sampled;
+	}
+
+	policy->total = 0;
+	for (i = 0; i < n; i++)
+		policy->total += policy->time[i];
+
+	policy->dtotal = dtotal;
+	policy->sampled = *now;
+	policy->sampled_once = true;
+
+	return 0;
+}
+
+static int read_cpufreq_info(struct tree *tree)
+{
+	uint64_t now = time_monotonic_us();
+
+	return tree_for_each(tree, read_cpufreq_cb, &now);
+}
+
+static inline double cpufreq_percent(uint64_t value, uint64_t total)
+{
+	return total ? (double)value * 100 / total : 0;
+}
+
+static int cpufreq_display_cb(struct tree *t, void *data)
+{
+	struct cpufreq_policy *policy = t->private;
+	int *line = data;
+	uint64_t dtrans = 0;
+	double seconds;
+	char *buf;
+	int i;
+
+	if (!t->parent)
+		return 0;
+
+	seconds = (double)policy->interval / 1000000;
+
+	for (i = 0; i < policy->nrfreqs; i++)
+		dtrans += policy->dtrans[i];
+
+	if (asprintf(&buf, "%-12s %-12.0f %-12s %-12s %-12s %.1f/s cpus %s %s",
+		     t->name, (double)policy->cur / 1000, "", "", "",
+		     seconds > 0 ? dtrans / seconds : 0, policy->cpus,
+		     policy->governor) < 0)
+		return -1;
+
+	display_print_line(CPUFREQ, *line, buf, 1, t);
+	(*line)++;
+	free(buf);
+
+	for (i = 0; i < policy->nrfreqs; i++) {
+
+		if (asprintf(&buf, "  %-10s %-12.0f %-12.1f %-12.1f %-12.1f",
+			     policy->freqs[i] == policy->cur ? "*" : "", (double)policy->freqs[i] / 1000,
+			     cpufreq_percent(policy->dtime[i], policy->dtotal),
+			     cpufreq_percent(policy->time[i], policy->total),
+			     seconds > 0 ? policy->dtrans[i] / seconds : 0) < 0)
+			return -1;
+
+		display_print_line(CPUFREQ, *line, buf, 0, t);
+		(*line)++;
+		free(buf);
+	}
+
+	return 0;
+}
+
+static int cpufreq_print_header(void)
+{
+	char *buf;
+	int ret;
+
+	if (asprintf(&buf, "%-12s %-12s %-12s %-12s %-12s %s", "Name",
+		     "Freq MHz", "Interval %", "Total %", "From /s",
+		     "Transitions") < 0)
+		return -1;
+
+	ret = display_column_name(buf);
+
+	free(buf);
+
+	return ret;
+}
+
+static int cpufreq_print_info(struct tree *tree)
+{
+	int ret, line = 0;
+
+	display_reset_cursor(CPUFREQ);
+
+	cpufreq_print_header();
+
+	ret = tree_for_each(tree, cpufreq_display_cb, &line);
+
+	display_refresh_pad(CPUFREQ);
+
+	return ret;
+}
+
+static int cpufreq_display(bool refresh)
+{
+	if (cpufreq_error || !cpufreq_tree) {
+		display_message(CPUFREQ,
+			"error: path " SYSFS_CPUFREQ " not found");
+		return -2;
+	}
+
+	if (refresh && read_cpufreq_info(cpufreq_tree))
+		return -1;
+
+	return cpufreq_print_info(cpufreq_tree);
+}
+
+static int cpufreq_dump_cb(struct tree *t, void *data)
+{
+	struct cpufreq_policy *policy = t->private;
+	int i;
+
+	if (!t->parent)
+		return 0;
+
+	printf("\n%s:\n", t->name);
+	printf("\tcpus: %s\n", policy->cpus);
+	printf("\tgovernor: %s\n", policy->governor);
+	printf("\tcur_freq: %lld kHz\n", policy->cur);
+
+	for (i = 0; i < policy->nrfreqs; i++)
+		printf("\t%llu kHz: %.1f%%\n",
+		       (unsigned long long)policy->freqs[i],
+		       cpufreq_percent(policy->time[i], policy->total));
+
+	return 0;
+}
+
+int cpufreq_dump(void)
+{
+	printf("\nCpufreq Information:\n");
+	printf("********************\n");
+
+	if (read_cpufreq_info(cpufreq_tree))
+		return -1;
+
+	return tree_for_each(cpufreq_tree, cpufreq_dump_cb, NULL);
+}
+
+static int cpufreq_snapshot_cb(struct tree *t, void *data)
+{
+	struct cpufreq_policy *policy = t->private;
+	struct snapshot *snap = data;
+
+	if (!t->parent)
+		return 0;
+
+	if (snapshot_node(snap, t->path) ||
+	    snapshot_string(snap, "cpus", policy->cpus) ||
+	    snapshot_string(snap, "governor", policy->governor) ||
+	    snapshot_int(snap, "cur_freq", policy->cur))
+		return -1;
+
+	return 0;
+}
+
+int cpufreq_snapshot(struct snapshot *snap)
+{
+	if (read_cpufreq_info(cpufreq_tree))
+		return -1;
+
+	return tree_for_each(cpufreq_tree, cpufreq_snapshot_cb, snap);
+}
+
+/*
+ * Find the frequencies of a policy and allocate its arrays at once
+ */
+static int cpufreq_policy_init(struct tree *t, struct cpufreq_policy *policy)
+{
+	uint64_t *arrays;
+	char *p;
+	int n = 0, nn;
+
+	policy->fd_cur = file_open_value(t->path, "scaling_cur_freq");
+	policy->fd_time = file_open_value(t->path, "stats/time_in_state");
+	policy->fd_trans = file_open_value(t->path, "stats/trans_table");
+
+	file_read_value(t->path, "related_cpus", "%254[^\n]", policy->cpus);
+	file_read_value(t->path, "scaling_governor", "%31s",
+			policy->governor);
+
+	/* the statistics are not compiled in */
+	if (policy->fd_time < 0)
+		return 0;
+
+	if (fd_read_buffer(policy->fd_time, &cpufreq_buf, &cpufreq_size) < 0)
+		return 0;
+
+	for (p = cpufreq_buf; *p; p++)
+		if (*p == '\n')
+			n++;
+
+	nn = n * n;
+
+	/* the frequency arrays then the transition matrices */
+	arrays = calloc(5 * n + 2 * nn, sizeof(*arrays));
+	if (!arrays)
+		return -1;
+
+	policy->freqs = arrays;
+	policy->time = arrays + n;
+	policy->ptime = arrays + 2 * n;
+	policy->dtime = arrays + 3 * n;
+	policy->dtrans = arrays + 4 * n;
+	policy->trans = arrays + 5 * n;
+	policy->ptrans = arrays + 5 * n + nn;
+
+	policy->nrfreqs = cpufreq_parse_time(cpufreq_buf, policy->freqs,
+					     policy->time, n);
+
+	return 0;
+}
+
+static int fill_cpufreq_cb(struct tree *t, void *data)
+{
+	struct cpufreq_policy *policy;
+
+	policy = malloc(sizeof(*policy));
+	if (!policy)
+		return -1;
+	memset(policy, 0, sizeof(*policy));
+	policy->fd_cur = policy->fd_time = policy->fd_trans = -1;
+	t->private = policy;
+
+	if (!t->parent)
+		return 0;
+
+	return cpufreq_policy_init(t, policy);
+}
+
+static struct display_ops cpufreq_ops = {
+	.display = cpufreq_display,
+};
+
+int cpufreq_init(void)
+{
+	int ret;
+
+	ret = display_register(CPUFREQ, &cpufreq_ops);
+	if (ret)
+		printf("error: cpufreq display register failed");
+
+	if (access(SYSFS_CPUFREQ, F_OK)) {
+		cpufreq_error = true; /* set the flag */
+		return -1;
+	}
+
+	cpufreq_tree = tree_load_shape(SYSFS_CPUFREQ, cpufreq_shape, true);
+	if (!cpufreq_tree)
+		return -1;
+
+	if (tree_for_each(cpufreq_tree, fill_cpufreq_cb, NULL))
+		return -1;
+
+	if (read_cpufreq_info(cpufreq_tree))
+		return -1;
+
+	return ret;
+}
@@ -0,0 +1,460 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * The idle states of the cpus. The counters of a state are read through
+ * held file descriptors into arrays indexed by cpu and state, all the
+ * counters being read in one pass per refresh. The view shows the
+ * states aggregated by name over the cpus having them, the clusters of
+ * a big.LITTLE system having different states at the same index, then
+ * the residency per cpu.
+ *
+ * With hundreds of cpus the number of files is above the default limit
+ * of open files, the limit is raised to the hard one and the counters
+ * which can't be kept opened are read by path.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#undef _GNU_SOURCE
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "powerdebug.h"
+#include "display.h"
+#include "cpuidle.h"
+#include "tree.h"
+#include "snapshot.h"
+#include "utils.h"
+
+#define SYSFS_CPU "/sys/devices/system/cpu"
+
+#define CPUIDLE_NAME_MAX 16
+
+enum cpuidle_counter {
+	CPUIDLE_USAGE,
+	CPUIDLE_TIME,
+	CPUIDLE_ABOVE,
+	CPUIDLE_BELOW,
+	CPUIDLE_COUNTER_MAX,
+};
+
+static const char *cpuidle_counters[] = {
+	[CPUIDLE_USAGE] = "usage",
+	[CPUIDLE_TIME]  = "time",
+	[CPUIDLE_ABOVE] = "above",
+	[CPUIDLE_BELOW] = "below",
+};
+
+/*
+ * The counters of all the states of all the cpus, the entry of a state
+ * of a cpu being at cpu * nrstates + state in each array.
+ *
+ * fds    : the counter files, -1 if not kept opened
+ * paths  : the state directories, to read the counters not opened
+ * value  : the last values of the counters
+ * delta  : the difference with the previous values
+ * nameidx  : the index of the name of the state in names
+ *
+ * names    : the distinct state names, in the order of the cpus
+ * namecpus : the number of cpus having a state of that name
+ */
+struct cpuidle_stats {
+	int nrcpus;
+	int nrstates;
+	int nrnames;
+	int *cpus;
+	char (*names)[CPUIDLE_NAME_MAX];
+	int *namecpus;
+	int *nameidx;
+	char **paths;
+	int *fds[CPUIDLE_COUNTER_MAX];
+	long long *value[CPUIDLE_COUNTER_MAX];
+	long long *delta[CPUIDLE_COUNTER_MAX];
+	uint64_t sampled;
+	uint64_t interval;
+};
+
+static struct cpuidle_stats cpuidle;
+static struct tree *cpuidle_tree;
+static bool cpuidle_error = false;
+
+static const char * const cpuidle_shape[] = {
+	"cpu[0-9]*", "cpuidle", "state[0-9]*", NULL
+};
+
+static int read_cpuidle_info(void)
+{
+	uint64_t now = time_monotonic_us();
+	int i, c, nr = cpuidle.nrcpus * cpuidle.nrstates;
+	long long value;
+
+	for (c = 0; c < CPUIDLE_COUNTER_MAX; c++) {
+
+		for (i = 0; i < nr; i++) {
+
+			if (!cpuidle.paths[i])
+				continue;
+
+			/* an offline cpu or a removed state has no activity */
+			if (cpuidle.fds[c][i] >= 0 ?
+			    fd_read_value(cpuidle.fds[c][i], &value) :
+			    file_read_value(cpuidle.paths[i],
+					    cpuidle_counters[c],
+					    "%lld", &value)) {
+				cpuidle.delta[c][i] = 0;
+				continue;
+			}
+
+			cpuidle.delta[c][i] = value - cpuidle.value[c][i];
+			cpuidle.value[c][i] = value;
+		}
+	}
+
+	cpuidle.interval = cpuidle.sampled ? now - cpuidle.sampled : 0;
+	cpuidle.sampled = now;
+
+	return 0;
+}
+
+static inline double cpuidle_percent(long long value, long long total)
+{
+	return total ? (double)value * 100 / total : 0;
+}
+
+static int cpuidle_print_line(int line, bool bold, char *buf)
+{
+	return display_print_line(CPUIDLE, line, buf, bold, NULL);
+}
+
+/*
+ * A line per state name with the counters of the cpus having it added
+ */
+static int cpuidle_print_states(int *line)
+{
+	long long sums[CPUIDLE_COUNTER_MAX];
+	double seconds = (double)cpuidle.interval / 1000000;
+	int c, s, i, nr = cpuidle.nrcpus * cpuidle.nrstates;
+	char *buf;
+
+	for (s = 0; s < cpuidle.nrnames; s++) {
+
+		memset(sums, 0, sizeof(sums));
+
+		for (c = 0; c < CPUIDLE_COUNTER_MAX; c++)
+			for (i = 0; i < nr; i++)
+				if (cpuidle.paths[i] && cpuidle.nameidx[i] == s)
+					sums[c] += cpuidle.delta[c][i];
+
+		if (asprintf(&buf, "%-12s %-12.1f %-12.1f %-12.1f %-12.1f",
+			     cpuidle.names[s],
+			     cpuidle_percent(sums[CPUIDLE_TIME],
+					     cpuidle.interval *
+					     cpuidle.namecpus[s]),
+			     seconds > 0 ? sums[CPUIDLE_USAGE] / seconds : 0,
+			     cpuidle_percent(sums[CPUIDLE_ABOVE],
+					     sums[CPUIDLE_USAGE]),
+			     cpuidle_percent(sums[CPUIDLE_BELOW],
+					     sums[CPUIDLE_USAGE])) < 0)
+			return -1;
+
+		cpuidle_print_line((*line)++, false, buf);
+		free(buf);
+	}
+
+	return 0;
+}
+
+/*
+ * A line per cpu with the residency of each state
+ */
+static int cpuidle_print_cpus(int *line)
+{
+	char buf[1024];
+	size_t len;
+	int s, cpu, i;
+
+	for (cpu = 0; cpu < cpuidle.nrcpus; cpu++) {
+
+		len = snprintf(buf, sizeof(buf), "cpu%-9d", cpuidle.cpus[cpu]);
+
+		for (s = 0; s < cpuidle.nrstates && len < sizeof(buf); s++) {
+			i = cpu * cpuidle.nrstates + s;
+			if (!cpuidle.paths[i])
+				continue;
+			len += snprintf(buf + len, sizeof(buf) - len,
+					" %s:%.1f%%",
+					cpuidle.names[cpuidle.nameidx[i]],
+					cpuidle_percent(
+						cpuidle.delta[CPUIDLE_TIME][i],
+						cpuidle.interval));
+		}
+
+		cpuidle_print_line((*line)++, false, buf);
+	}
+
+	return 0;
+}
+
+static int cpuidle_print_header(void)
+{
+	char *buf;
+	int ret;
+
+	if (asprintf(&buf, "%-12s %-12s %-12s %-12s %-12s", "State",
+		     "Residency %", "Entries/s", "Above %", "Below %") < 0)
+		return -1;
+
+	ret = display_column_name(buf);
+
+	free(buf);
+
+	return ret;
+}
+
+static int cpuidle_print_info(void)
+{
+	static char percpu[] = "Residency per cpu";
+	int ret, line = 0;
+
+	display_reset_cursor(CPUIDLE);
+
+	cpuidle_print_header();
+
+	ret = cpuidle_print_states(&line);
+	if (!ret) {
+		cpuidle_print_line(line++, true, percpu);
+		ret = cpuidle_print_cpus(&line);
+	}
+
+	display_refresh_pad(CPUIDLE);
+
+	return ret;
+}
+
+static int cpuidle_display(bool refresh)
+{
+	if (cpuidle_error || !cpuidle.nrcpus) {
+		display_message(CPUIDLE,
+			"error: no cpuidle state found in " SYSFS_CPU);
+		return -2;
+	}
+
+	if (refresh && read_cpuidle_info())
+		return -1;
+
+	return cpuidle_print_info();
+}
+
+int cpuidle_dump(void)
+{
+	int s, cpu, i;
+
+	printf("\nCpuidle Information:\n");
+	printf("********************\n");
+
+	if (read_cpuidle_info())
+		return -1;
+
+	for (cpu = 0; cpu < cpuidle.nrcpus; cpu++) {
+
+		printf("\ncpu%d:\n", cpuidle.cpus[cpu]);
+
+		for (s = 0; s < cpuidle.nrstates; s++) {
+			i = cpu * cpuidle.nrstates + s;
+			if (!cpuidle.paths[i])
+				continue;
+			printf("\t%s: usage %lld, time %lld us, above %lld, "
+			       "below %lld\n",
+			       cpuidle.names[cpuidle.nameidx[i]],
+			       cpuidle.value[CPUIDLE_USAGE][i],
+			       cpuidle.value[CPUIDLE_TIME][i],
+			       cpuidle.value[CPUIDLE_ABOVE][i],
+			       cpuidle.value[CPUIDLE_BELOW][i]);
+		}
+	}
+
+	return 0;
+}
+
+int cpuidle_snapshot(struct snapshot *snap)
+{
+	int s, cpu, i;
+
+	if (read_cpuidle_info())
+		return -1;
+
+	for (cpu = 0; cpu < cpuidle.nrcpus; cpu++)
+		for (s = 0; s < cpuidle.nrstates; s++) {
+			i = cpu * cpuidle.nrstates + s;
+			if (!cpuidle.paths[i])
+				continue;
+			if (snapshot_node(snap, cpuidle.paths[i]) ||
+			    snapshot_string(snap, "name",
+					    cpuidle.names[cpuidle.nameidx[i]]) ||
+			    snapshot_int(snap, "usage",
+					 cpuidle.value[CPUIDLE_USAGE][i]))
+				return -1;
+		}
+
+	return 0;
+}
+
+/*
+ * The position of a cpu in the arrays, the cpus being sorted by number
+ * whatever the order of the directory entries
+ */
+static int cpuidle_rank(struct tree *tree, struct tree *cpu)
+{
+	int number = atoi(cpu->name + strlen("cpu"));
+	struct tree *t;
+	int rank = 0;
+
+	for (t = tree->child; t; t = t->next)
+		if (t->child && atoi(t->name + strlen("cpu")) < number)
+			rank++;
+
+	return rank;
+}
+
+/*
+ * Find the name of a state among the names already found or add it
+ */
+static void cpuidle_add_name(int i)
+{
+	char name[CPUIDLE_NAME_MAX];
+	int s;
+
+	if (file_read_value(cpuidle.paths[i], "name", "%15s", name))
+		snprintf(name, sizeof(name), "state%d", i % cpuidle.nrstates);
+
+	for (s = 0; s < cpuidle.nrnames; s++)
+		if (!strcmp(cpuidle.names[s], name))
+			break;
+
+	if (s == cpuidle.nrnames)
+		strcpy(cpuidle.names[cpuidle.nrnames++], name);
+
+	cpuidle.nameidx[i] = s;
+	cpuidle.namecpus[s]++;
+}
+
+/*
+ * Allocate the arrays for the cpus and the states found in the tree,
+ * and open the counter files.
+ */
+static int cpuidle_setup(struct tree *tree)
+{
+	struct tree *cpu, *dir, *state;
+	int c, i, n, index;
+
+	for (cpu = tree->child; cpu; cpu = cpu->next) {
+		if (!cpu->child)
+			continue;
+		cpuidle.nrcpus++;
+		for (state = cpu->child->child; state; state = state->next) {
+			index = atoi(state->name + strlen("state"));
+			if (index + 1 > cpuidle.nrstates)
+				cpuidle.nrstates = index + 1;
+		}
+	}
+
+	n = cpuidle.nrcpus * cpuidle.nrstates;
+	if (!n)
+		return 0;
+
+	cpuidle.cpus = calloc(cpuidle.nrcpus, sizeof(*cpuidle.cpus));
+	cpuidle.names = calloc(n, sizeof(*cpuidle.names));
+	cpuidle.namecpus = calloc(n, sizeof(*cpuidle.namecpus));
+	cpuidle.nameidx = calloc(n, sizeof(*cpuidle.nameidx));
+	cpuidle.paths = calloc(n, sizeof(*cpuidle.paths));
+	if (!cpuidle.cpus || !cpuidle.names || !cpuidle.namecpus ||
+	    !cpuidle.nameidx || !cpuidle.paths)
+		return -1;
+
+	for (c = 0; c < CPUIDLE_COUNTER_MAX; c++) {
+		cpuidle.fds[c] = malloc(n * sizeof(*cpuidle.fds[c]));
+		cpuidle.value[c] = calloc(n, sizeof(*cpuidle.value[c]));
+		cpuidle.delta[c] = calloc(n, sizeof(*cpuidle.delta[c]));
+		if (!cpuidle.fds[c] || !cpuidle.value[c] || !cpuidle.delta[c])
+			return -1;
+		for (i = 0; i < n; i++)
+			cpuidle.fds[c][i] = -1;
+	}
+
+	/* the counter files are kept opened up to the hard limit */
+	file_raise_nofile();
+
+	for (cpu = tree->child; cpu; cpu = cpu->next) {
+
+		dir = cpu->child;
+		if (!dir)
+			continue;
+
+		n = cpuidle_rank(tree, cpu);
+		cpuidle.cpus[n] = atoi(cpu->name + strlen("cpu"));
+
+		for (state = dir->child; state; state = state->next) {
+
+			index = atoi(state->name + strlen("state"));
+			i = n * cpuidle.nrstates + index;
+
+			cpuidle.paths[i] = state->path;
+
+			for (c = 0; c < CPUIDLE_COUNTER_MAX; c++)
+				cpuidle.fds[c][i] = file_open_value(state->path,
+							cpuidle_counters[c]);
+		}
+	}
+
+	/* the names are indexed in the order of the cpus, not of the tree */
+	for (i = 0; i < cpuidle.nrcpus * cpuidle.nrstates; i++)
+		if (cpuidle.paths[i])
+			cpuidle_add_name(i);
+
+	return 0;
+}
+
+static struct display_ops cpuidle_ops = {
+	.display = cpuidle_display,
+};
+
+int cpuidle_init(void)
+{
+	int ret;
+
+	ret = display_register(CPUIDLE, &cpuidle_ops);
+	if (ret)
+		printf("error: cpuidle display register failed");
+
+	if (access(SYSFS_CPU, F_OK)) {
+		cpuidle_error = true; /* set the flag */
+		return -1;
+	}
+
+	cpuidle_tree = tree_load_shape(SYSFS_CPU, cpuidle_shape, true);
+	if (!cpuidle_tree)
+		return -1;
+
+	if (cpuidle_setup(cpuidle_tree))
+		return -1;
+
+	if (!cpuidle.nrcpus)
+		return -1;
+
+	if (read_cpuidle_info())
+		return -1;
+
+	return ret;
+}
@@ -0,0 +1,597 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * The devfreq devices (gpu, memory, buses) with the residency in each
+ * frequency computed from the trans_stat deltas, and the interconnect
+ * nodes with the bandwidth aggregated from their requests. The summary
+ * of the interconnect framework is read through a held file descriptor
+ * and parsed in a single pass, the nodes being kept in an array reused
+ * from one refresh to the next.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#undef _GNU_SOURCE
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+
+#include "powerdebug.h"
+#include "display.h"
+#include "devfreq.h"
+#include "tree.h"
+#include "snapshot.h"
+#include "utils.h"
+
+#define SYSFS_DEVFREQ "/sys/class/devfreq"
+#define DEBUGFS_INTERCONNECT "/sys/kernel/debug/interconnect/interconnect_summary"
+
+/*
+ * A devfreq device, the statistics are in arrays of nrfreqs entries
+ *
+ * freqs : the frequencies in Hz, in the trans_stat order
+ * time  : the time spent in each frequency, in ms
+ * ptime : the previous values of time
+ * dtime : the time spent in the last interval
+ */
+struct devfreq_device {
+	char governor[32];
+	int fd_cur;
+	int fd_trans;
+	long long cur;
+	int nrfreqs;
+	uint64_t *freqs;
+	uint64_t *time;
+	uint64_t *ptime;
+	uint64_t *dtime;
+	uint64_t total;
+	uint64_t dtotal;
+	uint64_t transitions;
+	uint64_t dtransitions;
+	uint64_t sampled;
+	uint64_t interval;
+	bool sampled_once;
+};
+
+/*
+ * An interconnect node with the aggregated bandwidth of its requests,
+ * in kBps
+ */
+struct icc_node {
+	char name[64];
+	unsigned long long avg;
+	unsigned long long peak;
+	int nrrequests;
+};
+
+static struct tree *devfreq_tree;
+static bool devfreq_error = false;
+
+static int icc_fd = -1;
+static struct icc_node *icc_nodes;
+static int icc_nrnodes;
+static int icc_maxnodes;
+
+/* reused to read the statistics files of all the devices */
+static char *devfreq_buf;
+static size_t devfreq_size;
+
+static const char * const devfreq_shape[] = { "*", NULL };
+
+/*
+ * Parse the trans_stat content: two header lines, then a line per
+ * frequency, the current one starting with '*', with the frequency
+ * followed by ':', the transitions to each frequency and the time spent
+ * in ms, then the total of the transitions.
+ * Returns the number of frequencies parsed
+ */
+static int devfreq_parse_trans(char *buf, struct devfreq_device *dev,
+			       int nrfreqs)
+{
+	char *p;
+	int i, j;
+
+	p = strchr(buf, '\n');
+	if (p)
+		p = strchr(p + 1, '\n');
+
+	for (i = 0; p && i < nrfreqs; i++) {
+
+		p++;
+		while (*p == ' ' || *p == '*')
+			p++;
+
+		if (!isdigit(*p))
+			break;
+
+		dev->freqs[i] = strtoull(p, &p, 10);
+		if (*p != ':')
+			break;
+		p++;
+
+		for (j = 0; j < nrfreqs; j++)
+			strtoull(p, &p, 10);
+
+		dev->time[i] = strtoull(p, &p, 10);
+
+		p = strchr(p, '\n');
+	}
+
+	if (p) {
+		p = strchr(p, ':');
+		if (p)
+			dev->transitions = strtoull(p + 1, NULL, 10);
+	}
+
+	return i;
+}
+
+static int read_devfreq_cb(struct tree *t, void *data)
+{
+	struct devfreq_device *dev = t->private;
+	uint64_t *now = data;
+	uint64_t transitions = dev->transitions;
+	int i, n = dev->nrfreqs;
+
+	if (!t->parent)
+		return 0;
+
+	if (dev->fd_cur >= 0)
+		fd_read_value(dev->fd_cur, &dev->cur);
+
+	if (!n)
+		return 0;
+
+	memcpy(dev->ptime, dev->time, sizeof(*dev->time) * n);
+
+	if (fd_read_buffer(dev->fd_trans, &devfreq_buf, &devfreq_size) > 0)
+		devfreq_parse_trans(devfreq_buf, dev, n);
+
+	/* the deltas of the whole arrays, the first sample has none */
+	if (dev->sampled_once) {
+
+		dev->dtotal = 0;
+		for (i = 0; i < n; i++) {
+			dev->dtime[i] = dev->time[i] - dev->ptime[i];
+			dev->dtotal += dev->dtime[i];
+		}
+
+		dev->dtransitions = dev->transitions - transitions;
+		dev->interval = *now - dev->sampled;
+	}
+
+	dev->total = 0;
+	for (i = 0; i < n; i++)
+		dev->total += dev->time[i];
+
+	dev->sampled = *now;
+	dev->sampled_once = true;
+
+	return 0;
+}
+
+static struct icc_node *icc_node_next(void)
+{
+	struct icc_node *nodes;
+	int max;
+
+	if (icc_nrnodes == icc_maxnodes) {
+		max = icc_maxnodes ? icc_maxnodes * 2 : 64;
+		nodes = realloc(icc_nodes, max * sizeof(*nodes));
+		if (!nodes)
+			return NULL;
+		icc_nodes = nodes;
+		icc_maxnodes = max;
+	}
+
+	return &icc_nodes[icc_nrnodes++];
+}
+
+/*
+ * Parse the interconnect summary: a header and a separator line, then
+ * a line per node starting at the first column with its name, the
+ * average and the peak bandwidth, followed by its requests indented.
+ */
+static int icc_parse_summary(char *buf)
+{
+	struct icc_node *node = NULL;
+	char *p, *eol;
+
+	icc_nrnodes = 0;
+
+	for (p = buf; *p; p = eol) {
+
+		eol = strchrnul(p, '\n');
+		if (*eol)
+			*eol++ = '\0';
+
+		/* the header and the separator */
+		if (*p == '-' || strstr(p, " node "))
+			continue;
+
+		if (*p == ' ') {
+			if (node)
+				node->nrrequests++;
+			continue;
+		}
+
+		node = icc_node_next();
+		if (!node)
+			return -1;
+
+		memset(node, 0, sizeof(*node));
+		if (sscanf(p, "%63s %llu %llu", node->name,
+			   &node->avg, &node->peak) != 3) {
+			icc_nrnodes--;
+			node = NULL;
+		}
+	}
+
+	return 0;
+}
+
+static int read_icc_info(void)
+{
+	if (icc_fd < 0)
+		return 0;
+
+	if (fd_read_buffer(icc_fd, &devfreq_buf, &devfreq_size) < 0)
+		return -1;
+
+	return icc_parse_summary(devfreq_buf);
+}
+
+static int read_devfreq_info(struct tree *tree)
+{
+	uint64_t now = time_monotonic_us();
+
+	if (tree && tree_for_each(tree, read_devfreq_cb, &now))
+		return -1;
+
+	return read_icc_info();
+}
+
+static inline double devfreq_percent(uint64_t value, uint64_t total)
+{
+	return total ? (double)value * 100 / total : 0;
+}
+
+static int devfreq_display_cb(struct tree *t, void *data)
+{
+	struct devfreq_device *dev = t->private;
+	int *line = data;
+	double seconds;
+	char *buf;
+	int i;
+
+	if (!t->parent)
+		return 0;
+
+	seconds = (double)dev->interval / 1000000;
+
+	if (asprintf(&buf, "%-20s %-12.0f %-12s %-12s %-12.1f %s", t->name,
+		     (double)dev->cur / 1000000, "", "",
+		     seconds > 0 ? dev->dtransitions / seconds : 0,
+		     dev->governor) < 0)
+		return -1;
+
+	display_print_line(DEVFREQ, *line, buf, 1, t);
+	(*line)++;
+	free(buf);
+
+	for (i = 0; i < dev->nrfreqs; i++) {
+
+		if (asprintf(&buf, "  %-18s %-12.0f %-12.1f %-12.1f",
+			     dev->freqs[i] == dev->cur ? "*" : "",
+			     (double)dev->freqs[i] / 1000000,
+			     devfreq_percent(dev->dtime[i], dev->dtotal),
+			     devfreq_percent(dev->time[i], dev->total)) < 0)
+			return -1;
+
+		display_print_line(DEVFREQ, *line, buf, 0, t);
+		(*line)++;
+		free(buf);
+	}
+
+	return 0;
+}
+
+static int icc_print_info(int *line)
+{
+	char *buf;
+	int i;
+
+	if (icc_fd < 0)
+		return 0;
+
+	if (asprintf(&buf, "%-20s %-12s %-12s %-12s", "Interconnect",
+		     "Avg kBps", "Peak kBps", "Requests") < 0)
+		return -1;
+
+	display_print_line(DEVFREQ, (*line)++, buf, 1, NULL);
+	free(buf);
+
+	for (i = 0; i < icc_nrnodes; i++) {
+
+		if (asprintf(&buf, "%-20s %-12llu %-12llu %-12d",
+			     icc_nodes[i].name, icc_nodes[i].avg,
+			     icc_nodes[i].peak, icc_nodes[i].nrrequests) < 0)
+			return -1;
+
+		display_print_line(DEVFREQ, (*line)++, buf, 0, NULL);
+		free(buf);
+	}
+
+	return 0;
+}
+
+static int devfreq_print_header(void)
+{
+	char *buf;
+	int ret;
+
+	if (asprintf(&buf, "%-20s %-12s %-12s %-12s %-12s %s", "Name",
+		     "Freq MHz", "Interval %", "Total %", "Trans /s",
+		     "Governor") < 0)
+		return -1;
+
+	ret = display_column_name(buf);
+
+	free(buf);
+
+	return ret;
+}
+
+static int devfreq_print_info(struct tree *tree)
+{
+	int ret = 0, line = 0;
+
+	display_reset_cursor(DEVFREQ);
+
+	devfreq_print_header();
+
+	if (tree)
+		ret = tree_for_each(tree, devfreq_display_cb, &line);
+
+	if (!ret)
+		ret = icc_print_info(&line);
+
+	display_refresh_pad(DEVFREQ);
+
+	return ret;
+}
+
+static int devfreq_display(bool refresh)
+{
+	if (devfreq_error) {
+		display_message(DEVFREQ,
+			"error: paths " SYSFS_DEVFREQ " and "
+			DEBUGFS_INTERCONNECT " not found");
+		return -2;
+	}
+
+	if (refresh && read_devfreq_info(devfreq_tree))
+		return -1;
+
+	return devfreq_print_info(devfreq_tree);
+}
+
+static int devfreq_dump_cb(struct tree *t, void *data)
+{
+	struct devfreq_device *dev = t->private;
+	int i;
+
+	if (!t->parent)
+		return 0;
+
+	printf("\n%s:\n", t->name);
+	printf("\tgovernor: %s\n", dev->governor);
+	printf("\tcur_freq: %lld Hz\n", dev->cur);
+
+	for (i = 0; i < dev->nrfreqs; i++)
+		printf("\t%llu Hz: %.1f%%\n",
+		       (unsigned long long)dev->freqs[i],
+		       devfreq_percent(dev->time[i], dev->total));
+
+	return 0;
+}
+
+int devfreq_dump(void)
+{
+	int i;
+
+	printf("\nDevfreq Information:\n");
+	printf("********************\n");
+
+	if (read_devfreq_info(devfreq_tree))
+		return -1;
+
+	if (devfreq_tree && tree_for_each(devfreq_tree, devfreq_dump_cb, NULL))
+		return -1;
+
+	if (icc_fd < 0)
+		return 0;
+
+	printf("\nInterconnect:\n");
+
+	for (i = 0; i < icc_nrnodes; i++)
+		printf("\t%s: avg %llu kBps, peak %llu kBps, %d requests\n",
+		       icc_nodes[i].name, icc_nodes[i].avg,
+		       icc_nodes[i].peak, icc_nodes[i].nrrequests);
+
+	return 0;
+}
+
+static int devfreq_snapshot_cb(struct tree *t, void *data)
+{
+	struct devfreq_device *dev = t->private;
+	struct snapshot *snap = data;
+
+	if (!t->parent)
+		return 0;
+
+	if (snapshot_node(snap, t->path) ||
+	    snapshot_string(snap, "governor", dev->governor) ||
+	    snapshot_int(snap, "cur_freq", dev->cur))
+		return -1;
+
+	return 0;
+}
+
+int devfreq_snapshot(struct snapshot *snap)
+{
+	char *path;
+	int i, ret;
+
+	if (read_devfreq_info(devfreq_tree))
+		return -1;
+
+	if (devfreq_tree &&
+	    tree_for_each(devfreq_tree, devfreq_snapshot_cb, snap))
+		return -1;
+
+	for (i = 0; i < icc_nrnodes; i++) {
+
+		if (asprintf(&path, "%s/%s", DEBUGFS_INTERCONNECT,
+			     icc_nodes[i].name) < 0)
+			return -1;
+
+		ret = snapshot_node(snap, path) ||
+			snapshot_int(snap, "avg_bw", icc_nodes[i].avg) ||
+			snapshot_int(snap, "peak_bw", icc_nodes[i].peak);
+
+		free(path);
+
+		if (ret)
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Count the frequency lines of trans_stat, they start with the
+ * frequency, after the '*' of the current one
+ */
+static int devfreq_count_freqs(const char *buf)
+{
+	const char *p;
+	int n = 0;
+
+	for (p = buf; p; p = strchr(p, '\n')) {
+
+		if (*p == '\n')
+			p++;
+
+		while (*p == ' ' || *p == '*')
+			p++;
+
+		if (isdigit(*p))
+			n++;
+	}
+
+	return n;
+}
+
+/*
+ * Find the frequencies of a device and allocate its arrays at once
+ */
+static int devfreq_device_init(struct tree *t, struct devfreq_device *dev)
+{
+	uint64_t *arrays;
+	int n;
+
+	dev->fd_cur = file_open_value(t->path, "cur_freq");
+	dev->fd_trans = file_open_value(t->path, "trans_stat");
+
+	file_read_value(t->path, "governor", "%31s", dev->governor);
+
+	/* the statistics are not available */
+	if (dev->fd_trans < 0)
+		return 0;
+
+	if (fd_read_buffer(dev->fd_trans, &devfreq_buf, &devfreq_size) < 0)
+		return 0;
+
+	n = devfreq_count_freqs(devfreq_buf);
+	if (!n)
+		return 0;
+
+	arrays = calloc(4 * n, sizeof(*arrays));
+	if (!arrays)
+		return -1;
+
+	dev->freqs = arrays;
+	dev->time = arrays + n;
+	dev->ptime = arrays + 2 * n;
+	dev->dtime = arrays + 3 * n;
+
+	dev->nrfreqs = devfreq_parse_trans(devfreq_buf, dev, n);
+
+	return 0;
+}
+
+static int fill_devfreq_cb(struct tree *t, void *data)
+{
+	struct devfreq_device *dev;
+
+	dev = malloc(sizeof(*dev));
+	if (!dev)
+		return -1;
+	memset(dev, 0, sizeof(*dev));
+	dev->fd_cur = dev->fd_trans = -1;
+	t->private = dev;
+
+	if (!t->parent)
+		return 0;
+
+	return devfreq_device_init(t, dev);
+}
+
+static struct display_ops devfreq_ops = {
+	.display = devfreq_display,
+};
+
+int devfreq_init(void)
+{
+	int ret;
+
+	ret = display_register(DEVFREQ, &devfreq_ops);
+	if (ret)
+		printf("error: devfreq display register failed");
+
+	icc_fd = open(DEBUGFS_INTERCONNECT, O_RDONLY | O_CLOEXEC);
+
+	if (access(SYSFS_DEVFREQ, F_OK)) {
+		if (icc_fd < 0) {
+			devfreq_error = true; /* set the flag */
+			return -1;
+		}
+	} else {
+		devfreq_tree = tree_load_shape(SYSFS_DEVFREQ,
+					       devfreq_shape, true);
+		if (!devfreq_tree)
+			return -1;
+
+		if (tree_for_each(devfreq_tree, fill_devfreq_cb, NULL))
+			return -1;
+	}
+
+	if (read_devfreq_info(devfreq_tree))
+		return -1;
+
+	return ret;
+}
@@ -13,17 +13,26 @@
  *       - initial API and implementation
  *******************************************************************************/
 
+#define _GNU_SOURCE
 #include <stdio.h>
+#undef _GNU_SOURCE
 #include <string.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
 #include <ncurses.h>
+#include <fcntl.h>
 #include <sys/types.h>
+#include <sys/ioctl.h>
+#include <sys/timerfd.h>
 #include <regex.h>
 #include "powerdebug.h"
 #include "mainloop.h"
 #include "regulator.h"
 #include "display.h"
+#include "utils.h"
 
 enum { PT_COLOR_DEFAULT = 1,
        PT_COLOR_HEADER_BAR,
@@ -43,6 +52,35 @@ static int current_win;
 /* Number of lines in the virtual window */
 static const int maxrows = 1024;
 
+/*
+ * Frame rate limiter: the keystrokes and the refresh requests are
+ * coalesced and the panel is rendered at most once per frame interval,
+ * the frame timer fires the deferred rendering.
+ */
+static uint64_t frame_interval = 1000000 / DISPLAY_DEFAULT_FPS;
+static uint64_t frame_last;
+static bool frame_pending;
+static bool frame_read;
+static int frame_fd = -1;
+
+/* the keystrokes go to the find prompt */
+static bool finding;
+
+/*
+ * Low bandwidth mode, for the slow serial or adb consoles: the lines
+ * are truncated to the screen width, the number of bytes written per
+ * frame is measured and a frame is skipped while the terminal output
+ * queue still holds a significant part of the previous one.
+ *
+ * lowbw_fd      : /proc/self/io, its 'wchar' counts the bytes written
+ * lowbw_bytes   : bytes written by the last rendered frame
+ * lowbw_average : moving average of the bytes written per frame
+ */
+static bool lowbw;
+static int lowbw_fd = -1;
+static unsigned long lowbw_bytes;
+static unsigned long lowbw_average;
+
 struct rowdata {
 	int attr;
 	void *data;
@@ -64,17 +102,53 @@ struct windata windata[] = {
 	[REGULATOR] = { .name = "Regulators" },
 	[SENSOR]    = { .name = "Sensors"    },
 	[GPIO]      = { .name = "Gpio"    },
+	[POWERCAP]  = { .name = "Powercap" },
+	[THERMAL]   = { .name = "Thermal" },
+	[CPUFREQ]   = { .name = "Cpufreq" },
+	[CPUIDLE]   = { .name = "Cpuidle" },
+	[DEVFREQ]   = { .name = "Devfreq" },
+	[GENPD]     = { .name = "Genpd" },
+	[RUNTIME_PM] = { .name = "Runtime PM" },
+	[WAKEUP]    = { .name = "Wakeup" },
+	[IRQ]       = { .name = "Irq" },
+	[SUSPEND]   = { .name = "Suspend" },
+	[POWER_SUPPLY] = { .name = "Supplies" },
+};
+
+static int ncurses_print_line(int win, int line, const char *str,
+			      bool bold, bool selected);
+static int ncurses_column_name(const char *line);
+static int ncurses_refresh_pad(int win, int scrolling);
+static int ncurses_reset_cursor(int win);
+
+static struct display_backend ncurses_backend = {
+	.print_line   = ncurses_print_line,
+	.column_name  = ncurses_column_name,
+	.refresh_pad  = ncurses_refresh_pad,
+	.reset_cursor = ncurses_reset_cursor,
 };
 
+static struct display_backend *backend = &ncurses_backend;
+
 static void display_fini(void)
 {
 	endwin();
 }
 
+static inline int display_tab_width(int win)
+{
+	return strlen(windata[win].name) + 2;
+}
+
+/*
+ * The tabs which don't fit in the width are scrolled so the current one
+ * is showed, a '<' or a '>' telling some are hidden on that side.
+ */
 static int display_show_header(int win)
 {
-	int i;
+	int i, first, width;
 	int curr_pointer = 0;
+	int maxx = getmaxx(header_win);
 	size_t array_size = sizeof(windata) / sizeof(windata[0]);
 
 	wattrset(header_win, COLOR_PAIR(PT_COLOR_HEADER_BAR));
@@ -84,15 +158,39 @@ static int display_show_header(int win)
 	mvwprintw(header_win, 0, curr_pointer, "PowerDebug %s", VERSION);
 	curr_pointer += 20;
 
-	for (i = 0; i < array_size; i++) {
+	/* the first tab showed, with the room for both markers */
+	for (first = 0; first < win; first++) {
+		for (i = first, width = 2; i <= win; i++)
+			width += display_tab_width(i);
+		if (curr_pointer + width <= maxx)
+			break;
+	}
+
+	if (first) {
+		wattroff(header_win, A_REVERSE);
+		mvwprintw(header_win, 0, curr_pointer++, "<");
+	}
+
+	for (i = first; i < array_size; i++) {
+
+		width = display_tab_width(i);
+		if (curr_pointer + width > maxx - (i < array_size - 1))
+			break;
+
 		if (win == i)
 			wattron(header_win, A_REVERSE);
 		else
 			wattroff(header_win, A_REVERSE);
 
 		mvwprintw(header_win, 0, curr_pointer, " %s ", windata[i].name);
-		curr_pointer += strlen(windata[i].name) + 2;
+		curr_pointer += width;
+	}
+
+	if (i < array_size) {
+		wattroff(header_win, A_REVERSE);
+		mvwprintw(header_win, 0, maxx - 1, ">");
 	}
+
 	wrefresh(header_win);
 
 	return 0;
@@ -105,7 +203,12 @@ static int display_show_footer(int win, char *string)
 {
 	werase(footer_win);
 	wattron(footer_win, A_REVERSE);
-	mvwprintw(footer_win, 0, 0, "%s", string ? string : footer_label);
+	if (!string && lowbw)
+		mvwprintw(footer_win, 0, 0, "%s | %lu B/frame", footer_label,
+			  lowbw_average);
+	else
+		mvwprintw(footer_win, 0, 0, "%s",
+			  string ? string : footer_label);
 	wattroff(footer_win, A_REVERSE);
 	wrefresh(footer_win);
 
@@ -127,14 +230,22 @@ static int display_refresh(int win, bool read)
 	return wrefresh(main_win);
 }
 
-int display_refresh_pad(int win)
+static int ncurses_refresh_pad(int win, int scrolling)
 {
 	int maxx, maxy;
 
 	getmaxyx(stdscr, maxy, maxx);
 
-	return prefresh(windata[win].pad, windata[win].scrolling,
-			0, 2, 0, maxy - 2, maxx);
+	/* the column names and the pad are sent in a single update */
+	if (pnoutrefresh(windata[win].pad, scrolling, 0, 2, 0, maxy - 2, maxx))
+		return -1;
+
+	return doupdate();
+}
+
+int display_refresh_pad(int win)
+{
+	return backend->refresh_pad(win, windata[win].scrolling);
 }
 
 void sigwinch_handler(int signo)
@@ -196,7 +307,15 @@ static int display_prev_panel(void)
 	return current_win;
 }
 
-static int display_next_line(void)
+/*
+ * Move the cursor of the current window by a number of lines, positive
+ * to go down, negative to go up. The moves are batched, the previous
+ * line is unselected only once whatever the number of lines.
+ *
+ * @lines : number of lines to move the cursor
+ * Returns the new cursor position
+ */
+static int display_move_cursor(int lines)
 {
 	int maxx, maxy;
 	int cursor = windata[current_win].cursor;
@@ -206,34 +325,18 @@ static int display_next_line(void)
 
 	getmaxyx(stdscr, maxy, maxx);
 
-	if (cursor >= nrdata)
+	if (!lines || cursor >= nrdata)
 		return cursor;
 
 	display_show_unselection(current_win, cursor, rowdata[cursor].attr);
-	if (cursor < nrdata - 1) {
+
+	for (; lines > 0 && cursor < nrdata - 1; lines--) {
 		if (cursor >= (maxy - 4 + scrolling))
 			scrolling++;
 		cursor++;
 	}
 
-	windata[current_win].scrolling = scrolling;
-	windata[current_win].cursor = cursor;
-
-	return cursor;
-}
-
-static int display_prev_line(void)
-{
-	int cursor = windata[current_win].cursor;
-	int nrdata = windata[current_win].nrdata;
-	int scrolling = windata[current_win].scrolling;
-	struct rowdata *rowdata = windata[current_win].rowdata;
-
-	if (cursor >= nrdata)
-		return cursor;
-
-	display_show_unselection(current_win, cursor, rowdata[cursor].attr);
-	if (cursor > 0) {
+	for (; lines < 0 && cursor > 0; lines++) {
 		if (cursor <= scrolling)
 			scrolling--;
 		cursor--;
@@ -245,6 +348,16 @@ static int display_prev_line(void)
 	return cursor;
 }
 
+static int display_next_line(void)
+{
+	return display_move_cursor(1);
+}
+
+static int display_prev_line(void)
+{
+	return display_move_cursor(-1);
+}
+
 static int display_set_row_data(int win, int line, void *data, int attr)
 {
 	struct rowdata *rowdata =  windata[win].rowdata;
@@ -263,39 +376,46 @@ static int display_set_row_data(int win, int line, void *data, int attr)
 	return 0;
 }
 
-int display_reset_cursor(int win)
+static int ncurses_reset_cursor(int win)
 {
-	windata[win].nrdata = 0;
 	werase(windata[win].pad);
 	return wmove(windata[win].pad, 0, 0);
 }
 
+int display_reset_cursor(int win)
+{
+	windata[win].nrdata = 0;
+	return backend->reset_cursor(win);
+}
+
 void display_message(int win, char *buf)
 {
-	display_reset_cursor(win);
-	wattron(windata[win].pad, WA_BOLD);
-	wprintw(windata[win].pad, "%s\n", buf);
-	wattroff(windata[win].pad, WA_BOLD);
-	display_refresh_pad(win);
+	backend->reset_cursor(win);
+	windata[win].nrdata = 0;
+	backend->print_line(win, 0, buf, true, false);
+	backend->refresh_pad(win, windata[win].scrolling);
 }
 
-int display_print_line(int win, int line, char *str, int bold, void *data)
+static int ncurses_print_line(int win, int line, const char *str,
+			      bool bold, bool selected)
 {
 	int attr = 0;
 
 	if (bold)
 		attr |= WA_BOLD;
 
-	if (line == windata[win].cursor)
+	if (selected)
 		attr |= WA_STANDOUT;
 
-	if (display_set_row_data(win, line, data, attr))
-		return -1;
-
 	if (attr)
 		wattron(windata[win].pad, attr);
 
-	wprintw(windata[win].pad, "%s\n", str);
+	if (lowbw) {
+		/* longer lines would wrap over the next pad line */
+		wprintw(windata[win].pad, "%.*s\n",
+			getmaxx(windata[win].pad) - 1, str);
+	} else
+		wprintw(windata[win].pad, "%s\n", str);
 
 	if (attr)
 		wattroff(windata[win].pad, attr);
@@ -303,6 +423,49 @@ int display_print_line(int win, int line, char *str, int bold, void *data)
 	return 0;
 }
 
+int display_print_line(int win, int line, char *str, int bold, void *data)
+{
+	int attr = 0;
+
+	if (bold)
+		attr |= WA_BOLD;
+
+	if (line == windata[win].cursor)
+		attr |= WA_STANDOUT;
+
+	if (display_set_row_data(win, line, data, attr))
+		return -1;
+
+	return backend->print_line(win, line, str, bold,
+				   line == windata[win].cursor);
+}
+
+/*
+ * Format and print a line of a window, the line number is incremented
+ * for the next one.
+ */
+int display_printf_line(int win, int *line, int bold, void *data,
+			const char *fmt, ...)
+{
+	va_list ap;
+	char *buf;
+	int ret;
+
+	va_start(ap, fmt);
+	ret = vasprintf(&buf, fmt, ap);
+	va_end(ap);
+
+	if (ret < 0)
+		return -1;
+
+	ret = display_print_line(win, *line, buf, bold, data);
+	(*line)++;
+
+	free(buf);
+
+	return ret;
+}
+
 static int display_find_keystroke(int fd, void *data);
 
 struct find_data {
@@ -391,68 +554,272 @@ static int display_switch_to_find(int fd)
 	if (mainloop_add(fd, display_find_keystroke, findd))
 		return -1;
 
+	finding = true;
+
 	if (display_show_footer(current_win, "find (esc to exit)?"))
 		return -1;
 
 	return 0;
 }
 
-static int display_keystroke(int fd, void *data)
+/*
+ * Returns the number of bytes written by the process so far, 0 if the
+ * information is not available.
+ */
+static unsigned long lowbw_written(void)
 {
-	int keystroke = getch();
+	char buf[256], *wchar;
+	ssize_t len;
 
-	switch (keystroke) {
+	if (lowbw_fd < 0)
+		return 0;
 
-	case KEY_RIGHT:
-	case '\t':
-		display_show_header(display_next_panel());
-		break;
+	len = pread(lowbw_fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		return 0;
+	buf[len] = '\0';
 
-	case KEY_LEFT:
-	case KEY_BTAB:
-		display_show_header(display_prev_panel());
-		break;
+	wchar = strstr(buf, "wchar:");
+	if (!wchar)
+		return 0;
 
-	case KEY_DOWN:
-		display_next_line();
-		break;
+	return strtoul(wchar + strlen("wchar:"), NULL, 10);
+}
 
-	case KEY_UP:
-		display_prev_line();
-		break;
+/*
+ * The terminal is still busy with the previous frames when more than
+ * half of an average frame is waiting in its output queue.
+ */
+static bool lowbw_congested(void)
+{
+	int queued;
 
-	case '\n':
-	case '\r':
-		display_select();
-		break;
+	if (ioctl(STDOUT_FILENO, TIOCOUTQ, &queued))
+		return false;
 
-	case 'v':
-	case 'V':
-	case 'd':
-	case 'D':
-		display_change(toupper(keystroke));
-		break;
+	return queued > 0 && queued >= lowbw_average / 2;
+}
 
-	case EOF:
-	case 'q':
-	case 'Q':
-		return 1;
+/*
+ * Render the current window now and forget about any pending frame.
+ */
+static int display_render(void)
+{
+	bool read = frame_read;
+	unsigned long written;
+	int ret;
 
-	case '/':
-		return display_switch_to_find(fd);
+	frame_pending = false;
+	frame_read = false;
+	frame_last = time_monotonic_us();
 
-	case 'r':
-	case 'R':
-		return display_refresh(current_win, true);
-	default:
+	if (!lowbw)
+		return display_refresh(current_win, read);
+
+	written = lowbw_written();
+
+	ret = display_refresh(current_win, read);
+
+	lowbw_bytes = lowbw_written() - written;
+	lowbw_average = (lowbw_average * 7 + lowbw_bytes) / 8;
+
+	display_show_footer(current_win, NULL);
+
+	return ret;
+}
+
+/*
+ * Ask for the current window to be rendered. If the last frame is too
+ * recent, the rendering is deferred to the next frame boundary and all
+ * the requests received in the meantime are merged into this frame.
+ *
+ * @read : the information must be read again before being displayed
+ * Returns 0 on success, < 0 otherwise
+ */
+static int display_schedule_refresh(bool read)
+{
+	struct itimerspec its = { };
+	uint64_t now, next;
+
+	frame_read |= read;
+
+	/* the timer is already armed, the frame will include this request */
+	if (frame_pending)
 		return 0;
-	}
 
-	display_refresh(current_win, false);
+	now = time_monotonic_us();
+	next = frame_last + frame_interval;
+
+	if (frame_fd < 0 || now >= next)
+		return display_render();
+
+	its.it_value.tv_sec = (next - now) / 1000000;
+	its.it_value.tv_nsec = ((next - now) % 1000000) * 1000;
+
+	if (timerfd_settime(frame_fd, 0, &its, NULL))
+		return display_render();
+
+	frame_pending = true;
 
 	return 0;
 }
 
+static int display_frame_timer(int fd, void *data)
+{
+	uint64_t expirations;
+
+	if (read(fd, &expirations, sizeof(expirations)) < 0 &&
+	    errno != EAGAIN)
+		return -1;
+
+	/* the frame may have been rendered already by a direct refresh */
+	if (!frame_pending || finding)
+		return 0;
+
+	/* give one more frame interval to the terminal to catch up */
+	if (lowbw && lowbw_congested()) {
+		frame_pending = false;
+		frame_last = time_monotonic_us();
+		return display_schedule_refresh(false);
+	}
+
+	return display_render();
+}
+
+/*
+ * Periodic refresh called by the mainloop, the information is read
+ * again and the frame goes through the frame rate limiter.
+ */
+static int display_tick(int fd, void *data)
+{
+	/* the search result must not be overwritten */
+	if (finding)
+		return 0;
+
+	return display_schedule_refresh(true);
+}
+
+/*
+ * Set the maximum number of frames per second, 0 means the rendering
+ * is not rate limited. Must be called before display_init.
+ */
+void display_set_framerate(unsigned int fps)
+{
+	frame_interval = fps ? 1000000 / fps : 0;
+}
+
+/*
+ * Enable the low bandwidth mode, the frames are rate limited in any
+ * case. Must be called before display_init.
+ */
+void display_set_lowbw(bool enable)
+{
+	lowbw = enable;
+
+	if (lowbw && !frame_interval)
+		frame_interval = 1000000 / DISPLAY_DEFAULT_FPS;
+}
+
+/*
+ * All the keystrokes pending in the input queue are processed in a row,
+ * so an auto-repeated key does not trigger a rendering per event: the
+ * cursor moves are accumulated and applied at once and the window is
+ * rendered at most once per frame.
+ */
+static int display_keystroke(int fd, void *data)
+{
+	int keystroke = getch();
+	bool redraw = false, read = false;
+	int lines = 0, ret = 0;
+
+	if (keystroke == EOF)
+		return 1;
+
+	nodelay(stdscr, TRUE);
+
+	for (; keystroke != ERR; keystroke = getch()) {
+
+		switch (keystroke) {
+
+		case KEY_DOWN:
+			lines++;
+			continue;
+
+		case KEY_UP:
+			lines--;
+			continue;
+		}
+
+		/* the other keys depend on the cursor position */
+		display_move_cursor(lines);
+		redraw |= lines != 0;
+		lines = 0;
+
+		switch (keystroke) {
+
+		case KEY_RIGHT:
+		case '\t':
+			display_show_header(display_next_panel());
+			break;
+
+		case KEY_LEFT:
+		case KEY_BTAB:
+			display_show_header(display_prev_panel());
+			break;
+
+		case '\n':
+		case '\r':
+			display_select();
+			break;
+
+		case 'v':
+		case 'V':
+		case 'd':
+		case 'D':
+		case 'e':
+		case 'E':
+		case 'w':
+		case 'W':
+		case 'f':
+		case 'F':
+			display_change(toupper(keystroke));
+			break;
+
+		case 'q':
+		case 'Q':
+			ret = 1;
+			goto out;
+
+		case '/':
+			/* flush the pending frame before leaving the panel */
+			if (redraw || frame_pending)
+				display_render();
+			ret = display_switch_to_find(fd);
+			goto out;
+
+		case 'r':
+		case 'R':
+			read = true;
+			break;
+
+		default:
+			continue;
+		}
+
+		redraw = true;
+	}
+
+	display_move_cursor(lines);
+	redraw |= lines != 0;
+
+	if (redraw)
+		ret = display_schedule_refresh(read);
+out:
+	nodelay(stdscr, FALSE);
+
+	return ret;
+}
+
 static int display_switch_to_main(int fd)
 {
 	if (mainloop_del(fd))
@@ -461,6 +828,8 @@ static int display_switch_to_main(int fd)
 	if (mainloop_add(fd, display_keystroke, NULL))
 		return -1;
 
+	finding = false;
+
 	if (display_show_header(current_win))
 		return -1;
 
@@ -556,6 +925,21 @@ int display_init(int wdefault)
 	if (mainloop_add(0, display_keystroke, NULL))
 		return -1;
 
+	if (mainloop_set_timeout(display_tick, NULL))
+		return -1;
+
+	if (lowbw)
+		lowbw_fd = open("/proc/self/io", O_RDONLY);
+
+	if (frame_interval) {
+		frame_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+		if (frame_fd < 0)
+			return -1;
+
+		if (mainloop_add(frame_fd, display_frame_timer, NULL))
+			return -1;
+	}
+
 	if (!initscr())
 		return -1;
 
@@ -609,20 +993,64 @@ int display_init(int wdefault)
 	if (display_show_footer(wdefault, NULL))
 		return -1;
 
+	frame_last = time_monotonic_us();
+
 	return display_refresh(wdefault, true);
 }
 
-int display_column_name(const char *line)
+static int ncurses_column_name(const char *line)
 {
 	werase(main_win);
 	wattron(main_win, A_BOLD);
-	mvwprintw(main_win, 0, 0, "%s", line);
+	if (lowbw)
+		mvwprintw(main_win, 0, 0, "%.*s", getmaxx(main_win) - 1, line);
+	else
+		mvwprintw(main_win, 0, 0, "%s", line);
 	wattroff(main_win, A_BOLD);
-	wrefresh(main_win);
+
+	/* the screen is updated when the pad is refreshed */
+	return wnoutrefresh(main_win);
+}
+
+int display_column_name(const char *line)
+{
+	return backend->column_name(line);
+}
+
+/*
+ * Replace the ncurses output by another backend, for instance the
+ * headless framebuffer. Must be called instead of display_init.
+ *
+ * @b : the backend the panels will be rendered with
+ * @wdefault : the window to be rendered by display_draw
+ */
+int display_set_backend(struct display_backend *b, int wdefault)
+{
+	if (!b || !b->print_line || !b->column_name ||
+	    !b->refresh_pad || !b->reset_cursor)
+		return -1;
+
+	backend = b;
+	current_win = wdefault;
 
 	return 0;
 }
 
+/*
+ * Render a window whatever is the window currently showed, the
+ * window becomes the current one.
+ *
+ * @win  : the window to be rendered
+ * @read : the information must be read again before being displayed
+ * Returns 0 on success, < 0 otherwise
+ */
+int display_draw(int win, bool read)
+{
+	current_win = win;
+
+	return display_refresh(win, read);
+}
+
 int display_register(int win, struct display_ops *ops)
 {
 	size_t array_size = sizeof(windata) / sizeof(windata[0]);
@@ -13,7 +13,7 @@
  *       - initial API and implementation
  *******************************************************************************/
 
-enum { CLOCK, REGULATOR, SENSOR, GPIO };
+enum { CLOCK, REGULATOR, SENSOR, GPIO, POWERCAP, THERMAL, CPUFREQ, CPUIDLE, DEVFREQ, GENPD, RUNTIME_PM, WAKEUP, IRQ, SUSPEND, POWER_SUPPLY };
 
 struct display_ops {
 	int (*display)(bool refresh);
@@ -23,8 +23,27 @@ struct display_ops {
 	int (*change)(int keyvalue);
 };
 
+/*
+ * Output used to render the panels, the default one is ncurses.
+ *
+ * print_line   : print the line number 'line' of the window
+ * column_name  : print the name of the columns above the window
+ * refresh_pad  : show the window content starting at line 'scrolling'
+ * reset_cursor : clear the window content before a new rendering
+ */
+struct display_backend {
+	int (*print_line)(int win, int line, const char *str,
+			  bool bold, bool selected);
+	int (*column_name)(const char *line);
+	int (*refresh_pad)(int win, int scrolling);
+	int (*reset_cursor)(int win);
+};
+
 extern int display_print_line(int window, int line, char *str,
 			      int bold, void *data);
+extern int display_printf_line(int window, int *line, int bold, void *data,
+			       const char *fmt, ...)
+	__attribute__((format(printf, 5, 6)));
 extern void display_message(int window, char *buf);
 
 extern int display_refresh_pad(int window);
@@ -32,7 +51,13 @@ extern int display_reset_cursor(int window);
 extern void *display_get_row_data(int window);
 
 extern int display_init(int wdefault);
+extern void display_set_framerate(unsigned int fps);
+extern void display_set_lowbw(bool enable);
+extern int display_set_backend(struct display_backend *b, int wdefault);
+extern int display_draw(int win, bool read);
 extern int display_register(int win, struct display_ops *ops);
 extern int display_column_name(const char *line);
 
 #define NAME_MAX 255
+
+#define DISPLAY_DEFAULT_FPS 20
@@ -0,0 +1,134 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * The power is derived from the energy counters: the energy consumed
+ * between two samples divided by the time between them. A counter
+ * integrates the power in hardware, so a few samples per minute give
+ * an exact average where polling an instantaneous power reading would
+ * miss the peaks.
+ *
+ * The history used for the average over a window is decimated, a
+ * reading is only kept every ENERGY_STEP, so a short sampling interval
+ * does not shrink the time it covers.
+ */
+
+#include <string.h>
+
+#include "energy.h"
+
+/*
+ * Initialize an energy counter.
+ *
+ * @e     : the energy counter
+ * @range : the value at which the counter wraps, 0 if unknown
+ */
+void energy_init(struct energy *e, uint64_t range)
+{
+	memset(e, 0, sizeof(*e));
+	e->range = range;
+}
+
+/*
+ * The energy consumed between two readings of a counter. A counter
+ * going backward has wrapped, at its range if known, otherwise at the
+ * 32 or 64 bits limit.
+ */
+static uint64_t energy_delta(struct energy *e, uint64_t value)
+{
+	uint64_t range = e->range;
+
+	if (value >= e->last)
+		return value - e->last;
+
+	if (!range && e->last <= UINT32_MAX)
+		range = (uint64_t)UINT32_MAX + 1;
+
+	/* a 64 bits counter wraps naturally */
+	return range ? range - e->last + value : value - e->last;
+}
+
+/*
+ * Add a sample of an energy counter.
+ *
+ * @e     : the energy counter
+ * @value : the counter value in microjoules
+ * @now   : the CLOCK_MONOTONIC time of the reading, in microseconds
+ */
+void energy_sample(struct energy *e, uint64_t value, uint64_t now)
+{
+	unsigned int last = (e->nrsamples - 1) % ENERGY_SAMPLES;
+	unsigned int i = e->nrsamples % ENERGY_SAMPLES;
+	uint64_t delta;
+
+	if (e->nrsamples) {
+
+		/* two readings at the same time give no power */
+		if (now <= e->time)
+			return;
+
+		delta = energy_delta(e, value);
+		e->total += delta;
+		e->power = (double)delta * 1000000 / (now - e->time);
+	}
+
+	e->last = value;
+	e->time = now;
+
+	if (e->nrsamples && now - e->samples[last].time < ENERGY_STEP)
+		return;
+
+	e->samples[i].total = e->total;
+	e->samples[i].time = now;
+	e->nrsamples++;
+}
+
+/*
+ * Returns the average power over the last interval in microwatts
+ */
+double energy_power(struct energy *e)
+{
+	return e->power;
+}
+
+/*
+ * Returns the average power in microwatts from the last reading back to
+ * the oldest sample of the history within 'window' microseconds, or
+ * over the last interval if there is none
+ */
+double energy_power_window(struct energy *e, uint64_t window)
+{
+	unsigned int i, j, nr;
+	int first = -1;
+
+	nr = e->nrsamples < ENERGY_SAMPLES ? e->nrsamples : ENERGY_SAMPLES;
+
+	for (i = 0; i < nr; i++) {
+
+		j = (e->nrsamples - 1 - i) % ENERGY_SAMPLES;
+
+		/* the last reading may be in the history */
+		if (e->samples[j].time == e->time)
+			continue;
+
+		if (e->time - e->samples[j].time > window)
+			break;
+
+		first = j;
+	}
+
+	if (first < 0)
+		return e->power;
+
+	return (double)(e->total - e->samples[first].total) * 1000000 /
+		(e->time - e->samples[first].time);
+}
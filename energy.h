@@ -0,0 +1,56 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+#ifndef __ENERGY_H
+#define __ENERGY_H
+
+#include <stdint.h>
+
+#define ENERGY_SAMPLES 32
+
+/* The sliding window used for the average power, in microseconds */
+#define ENERGY_WINDOW 30000000
+
+/*
+ * The minimum time between two samples of the history, so it covers the
+ * window whatever the sampling interval
+ */
+#define ENERGY_STEP (ENERGY_WINDOW / (ENERGY_SAMPLES - 2))
+
+/*
+ * An energy counter in microjoules, sampled to derive the power
+ *
+ * range   : the value at which the counter wraps, 0 if unknown
+ * last    : the last raw value of the counter
+ * time    : the time of the last reading
+ * total   : the energy counted since the first sample, without wrap
+ * samples : the history of total, a sample every ENERGY_STEP at most
+ * power   : the average power over the last interval, in microwatts
+ */
+struct energy {
+	uint64_t range;
+	uint64_t last;
+	uint64_t time;
+	uint64_t total;
+	struct {
+		uint64_t total;
+		uint64_t time;
+	} samples[ENERGY_SAMPLES];
+	unsigned int nrsamples;
+	double power;
+};
+
+extern void energy_init(struct energy *e, uint64_t range);
+extern void energy_sample(struct energy *e, uint64_t value, uint64_t now);
+extern double energy_power(struct energy *e);
+extern double energy_power_window(struct energy *e, uint64_t window);
+
+#endif
@@ -0,0 +1,544 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * The generic power domains. The tree of the domains, their subdomains
+ * and their devices is built once from pm_genpd_summary, the summary is
+ * then read through a held file descriptor at each refresh and parsed
+ * in a single pass, the lines being matched to the nodes with a hash
+ * keyed by the names of the summary.
+ * The on and off times of the domains are read through held file
+ * descriptors, so a refresh does not look up any path.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#undef _GNU_SOURCE
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+
+#include "powerdebug.h"
+#include "display.h"
+#include "genpd.h"
+#include "tree.h"
+#include "hash.h"
+#include "snapshot.h"
+#include "utils.h"
+
+#define DEBUGFS_GENPD "/sys/kernel/debug/pm_genpd"
+
+#define GENPD_STATUS_MAX 16
+
+/*
+ * A domain or a device of a domain
+ *
+ * key     : the name in the summary, the path for a device
+ * status  : the state of a domain, the runtime status of a device
+ * fd_on   : the active_time file of a domain, in ms
+ * fd_off  : the total_idle_time file of a domain, in ms
+ * on, off : the last values of these files
+ * don, doff : the differences with the previous values
+ */
+struct genpd_info {
+	bool expanded;
+	bool domain;
+	char *key;
+	char status[GENPD_STATUS_MAX];
+	int perf;
+	int fd_on;
+	int fd_off;
+	long long on;
+	long long off;
+	long long don;
+	long long doff;
+};
+
+/* a subdomain found in the summary, moved below its domain at init */
+struct genpd_link {
+	struct tree *domain;
+	char name[NAME_MAX];
+};
+
+static struct tree *genpd_tree;
+static struct hash *genpd_hash;
+static bool genpd_error = false;
+
+static int genpd_fd = -1;
+static char *genpd_buf;
+static size_t genpd_size;
+
+static struct genpd_info *genpd_alloc(void)
+{
+	struct genpd_info *info;
+
+	info = malloc(sizeof(*info));
+	if (info) {
+		memset(info, 0, sizeof(*info));
+		info->expanded = true;
+		info->fd_on = info->fd_off = -1;
+	}
+
+	return info;
+}
+
+/*
+ * Called for each line of the summary after the header.
+ *
+ * @line  : the line, nul terminated
+ * @data  : the private data of the caller
+ */
+typedef int (*genpd_line_t)(char *line, void *data);
+
+/*
+ * Parse the summary in a single pass: a header ending with a separator
+ * line, then a line per domain starting at the first column with its
+ * name and its state, followed by the indented lines of its
+ * subdomains, separated by commas, and of its devices starting with
+ * '/'. Older kernels give the subdomains on the line of the domain.
+ */
+static int genpd_parse_summary(char *buf, genpd_line_t cb, void *data)
+{
+	bool header = true;
+	char *p, *eol;
+
+	for (p = buf; *p; p = eol) {
+
+		eol = strchrnul(p, '\n');
+		if (*eol)
+			*eol++ = '\0';
+
+		if (header) {
+			header = *p != '-';
+			continue;
+		}
+
+		if (*p && cb(p, data))
+			return -1;
+	}
+
+	return 0;
+}
+
+static void genpd_read_state(struct genpd_info *info, const char *p)
+{
+	sscanf(p, "%*s %15s %d", info->status, &info->perf);
+}
+
+static int genpd_update_cb(char *line, void *data)
+{
+	struct tree *t;
+	char *p = line;
+	size_t len;
+
+	while (*p == ' ')
+		p++;
+
+	/* the subdomains don't change */
+	if (p != line && *p != '/')
+		return 0;
+
+	len = strcspn(p, " ");
+
+	t = hash_find(genpd_hash, p, len);
+	if (t)
+		genpd_read_state(t->private, p);
+
+	return 0;
+}
+
+static int read_genpd_cb(struct tree *t, void *data)
+{
+	struct genpd_info *info = t->private;
+	long long on, off;
+
+	if (!info->domain || info->fd_on < 0 || info->fd_off < 0)
+		return 0;
+
+	if (fd_read_value(info->fd_on, &on) ||
+	    fd_read_value(info->fd_off, &off))
+		return 0;
+
+	info->don = on - info->on;
+	info->doff = off - info->off;
+	info->on = on;
+	info->off = off;
+
+	return 0;
+}
+
+static int read_genpd_info(struct tree *tree)
+{
+	if (fd_read_buffer(genpd_fd, &genpd_buf, &genpd_size) < 0)
+		return -1;
+
+	if (genpd_parse_summary(genpd_buf, genpd_update_cb, NULL))
+		return -1;
+
+	return tree_for_each(tree, read_genpd_cb, NULL);
+}
+
+static inline double genpd_percent(long long value, long long total)
+{
+	return total ? (double)value * 100 / total : 0;
+}
+
+static int genpd_display_cb(struct tree *t, void *data)
+{
+	struct genpd_info *info = t->private;
+	int *line = data;
+	char *name, *buf;
+	int ret;
+
+	if (!t->parent)
+		return 0;
+
+	if (asprintf(&name, "%*s%s", (t->depth - 1) * 2, "", t->name) < 0)
+		return -1;
+
+	if (info->domain && info->fd_on >= 0)
+		ret = asprintf(&buf, "%-40s %-12s %-12.1f %-12.1f %-6d", name,
+			       info->status,
+			       genpd_percent(info->don, info->don + info->doff),
+			       genpd_percent(info->on, info->on + info->off),
+			       info->perf);
+	else
+		ret = asprintf(&buf, "%-40s %-12s %-12s %-12s %-6d", name,
+			       info->status, "-", "-", info->perf);
+
+	free(name);
+
+	if (ret < 0)
+		return -1;
+
+	display_print_line(GENPD, *line, buf, info->domain, t);
+	(*line)++;
+	free(buf);
+
+	return 0;
+}
+
+static int genpd_print_header(void)
+{
+	char *buf;
+	int ret;
+
+	if (asprintf(&buf, "%-40s %-12s %-12s %-12s %-6s", "Name", "Status",
+		     "Interval On%", "Total On%", "Perf") < 0)
+		return -1;
+
+	ret = display_column_name(buf);
+
+	free(buf);
+
+	return ret;
+}
+
+static bool genpd_is_collapsed(struct tree *t)
+{
+	struct genpd_info *info = t->private;
+
+	return t->parent && !info->expanded;
+}
+
+/*
+ * Show the domains whose parents are expanded, as the clocks
+ */
+static int genpd_print_info(struct tree *tree)
+{
+	int ret, line = 0;
+
+	display_reset_cursor(GENPD);
+
+	genpd_print_header();
+
+	ret = tree_for_each_visible(tree, genpd_is_collapsed,
+				    genpd_display_cb, &line);
+
+	display_refresh_pad(GENPD);
+
+	return ret;
+}
+
+static int genpd_display(bool refresh)
+{
+	if (genpd_error || !genpd_tree) {
+		display_message(GENPD,
+			"error: path " DEBUGFS_GENPD "/pm_genpd_summary "
+			"not found");
+		return -2;
+	}
+
+	if (refresh && read_genpd_info(genpd_tree))
+		return -1;
+
+	return genpd_print_info(genpd_tree);
+}
+
+static int genpd_select(void)
+{
+	struct tree *t = display_get_row_data(GENPD);
+	struct genpd_info *info = t->private;
+
+	info->expanded = !info->expanded;
+
+	return 0;
+}
+
+static int genpd_dump_cb(struct tree *t, void *data)
+{
+	struct genpd_info *info = t->private;
+
+	if (!t->parent)
+		return 0;
+
+	printf("%*s%s: %s", (t->depth - 1) * 2, "", t->name, info->status);
+
+	if (info->domain && info->fd_on >= 0)
+		printf(", on %lld ms, off %lld ms", info->on, info->off);
+
+	printf("\n");
+
+	return 0;
+}
+
+int genpd_dump(void)
+{
+	printf("\nGenpd Tree:\n");
+	printf("***********\n");
+
+	if (!genpd_tree || read_genpd_info(genpd_tree))
+		return -1;
+
+	return tree_for_each(genpd_tree, genpd_dump_cb, NULL);
+}
+
+static int genpd_snapshot_cb(struct tree *t, void *data)
+{
+	struct genpd_info *info = t->private;
+	struct snapshot *snap = data;
+
+	if (!t->parent)
+		return 0;
+
+	if (snapshot_node(snap, t->path) ||
+	    snapshot_string(snap, "status", info->status))
+		return -1;
+
+	return 0;
+}
+
+int genpd_snapshot(struct snapshot *snap)
+{
+	if (!genpd_tree || read_genpd_info(genpd_tree))
+		return -1;
+
+	return tree_for_each(genpd_tree, genpd_snapshot_cb, snap);
+}
+
+struct genpd_build {
+	struct tree *domain;
+	struct genpd_link *links;
+	int nrlinks;
+};
+
+static int genpd_add_link(struct genpd_build *build, const char *name)
+{
+	struct genpd_link *links;
+
+	links = realloc(build->links, (build->nrlinks + 1) * sizeof(*links));
+	if (!links)
+		return -1;
+	build->links = links;
+
+	links[build->nrlinks].domain = build->domain;
+	snprintf(links[build->nrlinks].name, NAME_MAX, "%s", name);
+	build->nrlinks++;
+
+	return 0;
+}
+
+/* the subdomains of a line, separated by commas and spaces */
+static int genpd_add_links(struct genpd_build *build, char *p)
+{
+	char *name;
+
+	for (name = strtok(p, ", "); name; name = strtok(NULL, ", "))
+		if (genpd_add_link(build, name))
+			return -1;
+
+	return 0;
+}
+
+static int genpd_open_counters(struct genpd_info *info, const char *name)
+{
+	char *path;
+
+	if (asprintf(&path, "%s/%s", DEBUGFS_GENPD, name) < 0)
+		return -1;
+
+	info->fd_on = file_open_value(path, "active_time");
+	info->fd_off = file_open_value(path, "total_idle_time");
+
+	free(path);
+
+	return 0;
+}
+
+static int genpd_build_cb(char *line, void *data)
+{
+	struct genpd_build *build = data;
+	struct genpd_info *info;
+	struct tree *t;
+	char *p = line, *name, *rest;
+
+	while (*p == ' ')
+		p++;
+
+	if (p != line && *p != '/') {
+		if (!build->domain)
+			return 0;
+		return genpd_add_links(build, p);
+	}
+
+	if (p != line && !build->domain)
+		return 0;
+
+	info = genpd_alloc();
+	if (!info)
+		return -1;
+
+	genpd_read_state(info, p);
+
+	rest = p + strcspn(p, " ");
+	if (*rest)
+		*rest++ = '\0';
+
+	info->key = strdup(p);
+	if (!info->key)
+		return -1;
+
+	/* a device is showed with the last component of its path */
+	name = strrchr(p, '/');
+	name = name ? name + 1 : p;
+
+	t = tree_add_node(p == line ? genpd_tree : build->domain, name);
+	if (!t)
+		return -1;
+	t->private = info;
+
+	if (hash_add(genpd_hash, info->key, t))
+		return -1;
+
+	if (p != line)
+		return 0;
+
+	info->domain = true;
+	build->domain = t;
+
+	if (genpd_open_counters(info, info->key))
+		return -1;
+
+	/* the subdomains on the same line, after the state */
+	while (*rest == ' ')
+		rest++;
+	rest += strcspn(rest, " ");
+	while (*rest == ' ')
+		rest++;
+
+	if (*rest && !isdigit(*rest))
+		return genpd_add_links(build, rest);
+
+	return 0;
+}
+
+/*
+ * Build the tree of the domains from the summary, the subdomains being
+ * moved below their domain once all the domains are known
+ */
+static int genpd_build_tree(void)
+{
+	struct genpd_build build = { 0 };
+	struct genpd_info *info;
+	struct tree *t;
+	int i, ret;
+
+	genpd_tree = tree_add_node(NULL, "genpd");
+	if (!genpd_tree)
+		return -1;
+
+	info = genpd_alloc();
+	if (!info)
+		return -1;
+	genpd_tree->private = info;
+
+	genpd_hash = hash_create(256);
+	if (!genpd_hash)
+		return -1;
+
+	if (fd_read_buffer(genpd_fd, &genpd_buf, &genpd_size) < 0)
+		return -1;
+
+	ret = genpd_parse_summary(genpd_buf, genpd_build_cb, &build);
+	if (ret)
+		goto out;
+
+	for (i = 0; i < build.nrlinks; i++) {
+
+		t = hash_find(genpd_hash, build.links[i].name,
+			      strlen(build.links[i].name));
+		if (!t)
+			continue;
+
+		/* a loop is ignored, tree_move refuses it */
+		info = t->private;
+		if (info->domain)
+			tree_move(t, build.links[i].domain);
+	}
+
+	ret = tree_index(genpd_tree);
+out:
+	free(build.links);
+
+	return ret;
+}
+
+static struct display_ops genpd_ops = {
+	.display = genpd_display,
+	.select  = genpd_select,
+};
+
+int genpd_init(void)
+{
+	int ret;
+
+	ret = display_register(GENPD, &genpd_ops);
+	if (ret)
+		printf("error: genpd display register failed");
+
+	genpd_fd = open(DEBUGFS_GENPD "/pm_genpd_summary", O_RDONLY | O_CLOEXEC);
+	if (genpd_fd < 0) {
+		genpd_error = true; /* set the flag */
+		return -1;
+	}
+
+	if (genpd_build_tree())
+		return -1;
+
+	if (read_genpd_info(genpd_tree))
+		return -1;
+
+	return ret;
+}
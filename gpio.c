@@ -29,6 +29,7 @@
 #include "powerdebug.h"
 #include "display.h"
 #include "tree.h"
+#include "snapshot.h"
 #include "utils.h"
 
 #define SYSFS_GPIO "/sys/class/gpio"
@@ -62,31 +63,8 @@ static struct gpio_info *gpio_alloc(void)
 	return gi;
 }
 
-static int gpio_filter_cb(const char *name)
-{
-	/* let's ignore some directories in order to avoid to be
-	 * pulled inside the sysfs circular symlinks mess/hell
-	 * (choose the word which fit better)
-	 */
-	if (!strcmp(name, "device"))
-		return 1;
-
-	if (!strcmp(name, "subsystem"))
-		return 1;
-
-	if (!strcmp(name, "driver"))
-		return 1;
-
-        /* we want to ignore the gpio chips */
-	if (strstr(name, "chip"))
-		return 1;
-
-        /* we are not interested by the power value */
-	if (!strcmp(name, "power"))
-		return 1;
-
-	return 0;
-}
+/* only the exported gpios, not the gpio chips */
+static const char * const gpio_shape[] = { "gpio[0-9]*", NULL };
 
 static inline int read_gpio_cb(struct tree *t, void *data)
 {
@@ -315,6 +293,32 @@ static int gpio_change(int keyvalue)
 	return 0;
 }
 
+static int gpio_snapshot_cb(struct tree *t, void *data)
+{
+	struct snapshot *snap = data;
+	struct gpio_info *gpio = t->private;
+
+	if (!t->parent)
+		return 0;
+
+	if (snapshot_node(snap, t->path) ||
+	    snapshot_int(snap, "value", gpio->value) ||
+	    snapshot_int(snap, "active_low", gpio->active_low) ||
+	    snapshot_string(snap, "edge", gpio->edge) ||
+	    snapshot_string(snap, "direction", gpio->direction))
+		return -1;
+
+	return 0;
+}
+
+int gpio_snapshot(struct snapshot *snap)
+{
+	if (read_gpio_info(gpio_tree))
+		return -1;
+
+	return tree_for_each(gpio_tree, gpio_snapshot_cb, snap);
+}
+
 static struct display_ops gpio_ops = {
 	.display = gpio_display,
 	.change = gpio_change,
@@ -373,7 +377,7 @@ int gpio_init(void)
 
 	export_free_gpios();
 
-	gpio_tree = tree_load(SYSFS_GPIO, gpio_filter_cb, false);
+	gpio_tree = tree_load_shape(SYSFS_GPIO, gpio_shape, true);
 	if (!gpio_tree)
 		return -1;
 
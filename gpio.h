@@ -13,5 +13,8 @@
  *       - initial API and implementation
  *******************************************************************************/
 
+struct snapshot;
+
 extern int gpio_init(void);
 extern int gpio_dump(void);
+extern int gpio_snapshot(struct snapshot *snap);
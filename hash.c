@@ -0,0 +1,193 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * A minimal hash table indexed by strings, with open addressing and
+ * linear probing. The keys are not copied, they must stay valid as long
+ * as the table is used. The lookup takes the length of the key, so the
+ * key can be found directly in a buffer being parsed.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "hash.h"
+
+struct hash_entry {
+	const char *key;
+	size_t len;
+	uint32_t hash;
+	void *data;
+};
+
+struct hash {
+	struct hash_entry *entries;
+	unsigned int size;
+	unsigned int count;
+};
+
+/* FNV-1a */
+static inline uint32_t hash_string(const char *key, size_t len)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		hash ^= (unsigned char)key[i];
+		hash *= 16777619;
+	}
+
+	return hash;
+}
+
+static struct hash_entry *hash_lookup(struct hash *h, const char *key,
+				      size_t len, uint32_t hash)
+{
+	unsigned int i = hash & (h->size - 1);
+	struct hash_entry *e;
+
+	for (;;) {
+		e = &h->entries[i];
+
+		if (!e->key)
+			return e;
+
+		if (e->hash == hash && e->len == len &&
+		    !memcmp(e->key, key, len))
+			return e;
+
+		i = (i + 1) & (h->size - 1);
+	}
+}
+
+static int hash_resize(struct hash *h, unsigned int size)
+{
+	struct hash_entry *entries = h->entries, *e;
+	unsigned int i, oldsize = h->size;
+
+	h->entries = calloc(size, sizeof(*h->entries));
+	if (!h->entries) {
+		h->entries = entries;
+		return -1;
+	}
+	h->size = size;
+
+	for (i = 0; i < oldsize; i++) {
+		if (!entries[i].key)
+			continue;
+		e = hash_lookup(h, entries[i].key, entries[i].len,
+				entries[i].hash);
+		*e = entries[i];
+	}
+
+	free(entries);
+
+	return 0;
+}
+
+/*
+ * Create a hash table.
+ *
+ * @nrentries : the expected number of entries, the table grows if needed
+ * Returns the hash table on success, NULL otherwise
+ */
+struct hash *hash_create(unsigned int nrentries)
+{
+	struct hash *h;
+	unsigned int size = 16;
+
+	/* keep the load factor under 1/2 */
+	while (size < nrentries * 2)
+		size <<= 1;
+
+	h = malloc(sizeof(*h));
+	if (!h)
+		return NULL;
+
+	h->entries = calloc(size, sizeof(*h->entries));
+	if (!h->entries) {
+		free(h);
+		return NULL;
+	}
+
+	h->size = size;
+	h->count = 0;
+
+	return h;
+}
+
+void hash_free(struct hash *h)
+{
+	if (!h)
+		return;
+
+	free(h->entries);
+	free(h);
+}
+
+/*
+ * Add an entry in the table, an entry with the same key is replaced.
+ *
+ * @key  : a nul terminated string, not copied
+ * @data : the data associated with the key
+ * Returns 0 on success, -1 otherwise
+ */
+int hash_add(struct hash *h, const char *key, void *data)
+{
+	return hash_add_key(h, key, strlen(key), data);
+}
+
+/*
+ * Same as hash_add with a key of any content.
+ *
+ * @key  : the key, not copied
+ * @len  : the length of the key
+ * @data : the data associated with the key
+ * Returns 0 on success, -1 otherwise
+ */
+int hash_add_key(struct hash *h, const char *key, size_t len, void *data)
+{
+	uint32_t hash = hash_string(key, len);
+	struct hash_entry *e;
+
+	if ((h->count + 1) * 2 > h->size && hash_resize(h, h->size * 2))
+		return -1;
+
+	e = hash_lookup(h, key, len, hash);
+	if (!e->key)
+		h->count++;
+
+	e->key = key;
+	e->len = len;
+	e->hash = hash;
+	e->data = data;
+
+	return 0;
+}
+
+/*
+ * Find the data associated with a key.
+ *
+ * @key : the key, not necessarily nul terminated
+ * @len : the length of the key
+ * Returns the data on success, NULL if the key is not in the table
+ */
+void *hash_find(struct hash *h, const char *key, size_t len)
+{
+	return hash_lookup(h, key, len, hash_string(key, len))->data;
+}
+
+unsigned int hash_count(struct hash *h)
+{
+	return h->count;
+}
@@ -0,0 +1,27 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+#ifndef __HASH_H
+#define __HASH_H
+
+#include <stddef.h>
+
+struct hash;
+
+extern struct hash *hash_create(unsigned int nrentries);
+extern void hash_free(struct hash *h);
+extern int hash_add(struct hash *h, const char *key, void *data);
+extern int hash_add_key(struct hash *h, const char *key, size_t len,
+			void *data);
+extern void *hash_find(struct hash *h, const char *key, size_t len);
+extern unsigned int hash_count(struct hash *h);
+
+#endif
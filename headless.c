@@ -0,0 +1,185 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * Headless display backend: the panels are rendered into an in-memory
+ * framebuffer instead of a terminal. This allows to measure the cost of
+ * the rendering and to compare the output with a reference.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "display.h"
+#include "headless.h"
+
+/* Number of lines in the virtual window, same as the ncurses pads */
+#define HEADLESS_MAXROWS 1024
+
+/*
+ * The framebuffer is made of :
+ *
+ * pad    : the virtual window where the lines are printed
+ * screen : the visible part of the pad, header line included
+ * nrrows : number of lines printed in the pad since the last reset
+ */
+static struct framebuffer {
+	char *pad;
+	char *screen;
+	int width;
+	int height;
+	int nrrows;
+	unsigned long frames;
+} fb;
+
+static inline char *headless_row(char *buf, int row)
+{
+	return buf + row * (fb.width + 1);
+}
+
+static void headless_copy(char *dst, const char *str)
+{
+	size_t len = strlen(str);
+
+	if (len > fb.width)
+		len = fb.width;
+
+	memcpy(dst, str, len);
+	memset(dst + len, ' ', fb.width - len);
+}
+
+static int headless_print_line(int win, int line, const char *str,
+			       bool bold, bool selected)
+{
+	if (line < 0 || line >= HEADLESS_MAXROWS)
+		return -1;
+
+	headless_copy(headless_row(fb.pad, line), str);
+
+	if (line >= fb.nrrows)
+		fb.nrrows = line + 1;
+
+	return 0;
+}
+
+static int headless_column_name(const char *line)
+{
+	headless_copy(headless_row(fb.screen, 0), line);
+
+	return 0;
+}
+
+static int headless_refresh_pad(int win, int scrolling)
+{
+	int i, row;
+
+	for (i = 1; i < fb.height; i++) {
+
+		row = scrolling + i - 1;
+
+		if (row < fb.nrrows)
+			memcpy(headless_row(fb.screen, i),
+			       headless_row(fb.pad, row), fb.width);
+		else
+			memset(headless_row(fb.screen, i), ' ', fb.width);
+	}
+
+	fb.frames++;
+
+	return 0;
+}
+
+static int headless_reset_cursor(int win)
+{
+	int i;
+
+	/* only the lines printed by the previous frame are dirty */
+	for (i = 0; i < fb.nrrows; i++)
+		memset(headless_row(fb.pad, i), ' ', fb.width);
+
+	fb.nrrows = 0;
+
+	return 0;
+}
+
+static struct display_backend headless_backend = {
+	.print_line   = headless_print_line,
+	.column_name  = headless_column_name,
+	.refresh_pad  = headless_refresh_pad,
+	.reset_cursor = headless_reset_cursor,
+};
+
+/*
+ * Allocate the framebuffer, the lines are nul terminated in order to
+ * be dumped easily.
+ *
+ * @width  : number of columns of the screen
+ * @height : number of lines of the screen, the column names included
+ * Returns the backend to be passed to display_set_backend, NULL otherwise
+ */
+struct display_backend *headless_init(int width, int height)
+{
+	int i;
+
+	if (width <= 0 || height <= 1)
+		return NULL;
+
+	fb.width = width;
+	fb.height = height;
+
+	fb.pad = malloc((width + 1) * HEADLESS_MAXROWS);
+	fb.screen = malloc((width + 1) * height);
+	if (!fb.pad || !fb.screen) {
+		free(fb.pad);
+		free(fb.screen);
+		return NULL;
+	}
+
+	for (i = 0; i < HEADLESS_MAXROWS; i++) {
+		memset(headless_row(fb.pad, i), ' ', width);
+		headless_row(fb.pad, i)[width] = '\0';
+	}
+
+	for (i = 0; i < height; i++) {
+		memset(headless_row(fb.screen, i), ' ', width);
+		headless_row(fb.screen, i)[width] = '\0';
+	}
+
+	return &headless_backend;
+}
+
+/*
+ * Write the visible content of the framebuffer, as it would be showed
+ * on a terminal, trailing blanks removed.
+ */
+void headless_dump(FILE *f)
+{
+	int i, len;
+	char *row;
+
+	for (i = 0; i < fb.height; i++) {
+
+		row = headless_row(fb.screen, i);
+
+		for (len = fb.width; len > 0 && row[len - 1] == ' '; len--)
+			;
+
+		fprintf(f, "%.*s\n", len, row);
+	}
+}
+
+unsigned long headless_frames(void)
+{
+	return fb.frames;
+}
@@ -0,0 +1,559 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * The interrupt rates from /proc/interrupts. The file is read in a
+ * buffer kept across the refreshes and scanned once, the counters being
+ * stored in a matrix of interrupts by cpus. The deltas are computed over
+ * the whole matrix in a single loop the compiler can vectorize, then
+ * summed per interrupt and per cpu.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#undef _GNU_SOURCE
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "powerdebug.h"
+#include "display.h"
+#include "irq.h"
+#include "snapshot.h"
+#include "utils.h"
+
+#define PROC_INTERRUPTS "/proc/interrupts"
+
+#define IRQ_LABEL_MAX 16
+#define IRQ_DESC_MAX 48
+
+/*
+ * An interrupt line of the file
+ *
+ * label : the number or the name before ':'
+ * desc  : the controller and the handlers, after the counters
+ * rate  : the interrupts per second, all the cpus added
+ */
+struct irq_info {
+	char label[IRQ_LABEL_MAX];
+	char desc[IRQ_DESC_MAX];
+	double rate;
+	uint64_t total;
+};
+
+/*
+ * The counters of the interrupts, the counter of an interrupt on a cpu
+ * being at irq * nrcpus + cpu in the matrices
+ *
+ * cur, prev : the counters of the last and the previous refresh
+ * delta     : the difference between them
+ * cpus      : the cpu numbers of the columns, offline cpus are missing
+ * cpurate   : the interrupts per second of each cpu
+ * header    : the header line the columns were parsed from
+ */
+struct irq_stats {
+	char *header;
+	int nrcpus;
+	int nrirqs;
+	int maxirqs;
+	int *cpus;
+	double *cpurate;
+	struct irq_info *irqs;
+	struct irq_info **ranked;
+	uint64_t *cur;
+	uint64_t *prev;
+	uint64_t *delta;
+	uint64_t sampled;
+	uint64_t interval;
+};
+
+static struct irq_stats irq;
+static int irq_fd = -1;
+static char *irq_buf;
+static size_t irq_size;
+static bool irq_error = false;
+
+static inline const char *irq_skip_spaces(const char *p)
+{
+	while (*p == ' ')
+		p++;
+
+	return p;
+}
+
+/*
+ * A decimal number without the locale and the error handling of
+ * strtoull, the counters are only digits.
+ */
+static inline const char *irq_scan_number(const char *p, uint64_t *value)
+{
+	uint64_t v = 0;
+
+	while ((unsigned)(*p - '0') < 10)
+		v = v * 10 + (*p++ - '0');
+
+	*value = v;
+
+	return p;
+}
+
+/*
+ * The header gives a column per online cpu, "CPU" followed by the cpu
+ * number. It changes when a cpu is plugged or unplugged, the matrices
+ * sized with the number of cpus are then emptied, to be grown again by
+ * the scan of the interrupts.
+ * Returns 1 if the cpus changed since the last scan, 0 if they did not,
+ * -1 on error
+ */
+static int irq_parse_header(const char *buf)
+{
+	size_t len = strcspn(buf, "\n");
+	const char *p = buf;
+	double *cpurate;
+	char *header;
+	int nr = 0, *cpus;
+
+	if (irq.header && strlen(irq.header) == len &&
+	    !memcmp(irq.header, buf, len))
+		return 0;
+
+	while ((p = strstr(p, "CPU")) && p < buf + len) {
+
+		cpus = realloc(irq.cpus, (nr + 1) * sizeof(*cpus));
+		if (!cpus)
+			return -1;
+		irq.cpus = cpus;
+
+		p += strlen("CPU");
+		irq.cpus[nr++] = atoi(p);
+	}
+
+	if (!nr)
+		return -1;
+
+	cpurate = realloc(irq.cpurate, nr * sizeof(*cpurate));
+	if (!cpurate)
+		return -1;
+	irq.cpurate = cpurate;
+
+	header = strndup(buf, len);
+	if (!header)
+		return -1;
+
+	free(irq.header);
+	irq.header = header;
+	irq.nrcpus = nr;
+	irq.nrirqs = 0;
+	irq.maxirqs = 0;
+
+	return 1;
+}
+
+static int irq_grow(int nrirqs)
+{
+	struct irq_info *irqs;
+	uint64_t *cur, *prev, *delta;
+	size_t n;
+	int max = irq.maxirqs ? irq.maxirqs * 2 : 64;
+
+	if (nrirqs < irq.maxirqs)
+		return 0;
+
+	n = max * irq.nrcpus;
+
+	irqs = realloc(irq.irqs, max * sizeof(*irqs));
+	if (!irqs)
+		return -1;
+	irq.irqs = irqs;
+
+	cur = realloc(irq.cur, n * sizeof(*cur));
+	prev = realloc(irq.prev, n * sizeof(*prev));
+	delta = realloc(irq.delta, n * sizeof(*delta));
+	if (cur)
+		irq.cur = cur;
+	if (prev)
+		irq.prev = prev;
+	if (delta)
+		irq.delta = delta;
+	if (!cur || !prev || !delta)
+		return -1;
+
+	irq.maxirqs = max;
+
+	return 0;
+}
+
+/*
+ * Scan the file once: a line per interrupt with its label followed by
+ * ':', a counter per cpu, fewer for the architecture specific counters,
+ * and the description.
+ * Returns 1 if the interrupts changed since the last scan, 0 if they
+ * did not, -1 on error
+ */
+static int irq_parse(const char *buf)
+{
+	const char *p, *label;
+	struct irq_info *info;
+	uint64_t *counters;
+	bool changed = false;
+	size_t len;
+	int c, n = 0;
+
+	p = strchr(buf, '\n');
+
+	for (; p && *++p; p = strchr(p, '\n'), n++) {
+
+		if (irq_grow(n))
+			return -1;
+
+		info = &irq.irqs[n];
+		counters = &irq.cur[n * irq.nrcpus];
+
+		label = irq_skip_spaces(p);
+		p = strchr(label, ':');
+		if (!p)
+			break;
+
+		len = p - label;
+		if (len >= IRQ_LABEL_MAX)
+			len = IRQ_LABEL_MAX - 1;
+
+		if (n >= irq.nrirqs || strncmp(info->label, label, len) ||
+		    info->label[len]) {
+			memcpy(info->label, label, len);
+			info->label[len] = '\0';
+			changed = true;
+		}
+
+		p++;
+
+		for (c = 0; c < irq.nrcpus; c++) {
+			p = irq_skip_spaces(p);
+			if ((unsigned)(*p - '0') >= 10)
+				break;
+			p = irq_scan_number(p, &counters[c]);
+		}
+
+		for (; c < irq.nrcpus; c++)
+			counters[c] = 0;
+
+		/*
+		 * The description is only copied when it changes, as when
+		 * a handler is added to a shared line, the counters of
+		 * the line stay valid
+		 */
+		p = irq_skip_spaces(p);
+		len = strcspn(p, "\n");
+		if (len >= IRQ_DESC_MAX)
+			len = IRQ_DESC_MAX - 1;
+		if (changed || strncmp(info->desc, p, len) ||
+		    info->desc[len]) {
+			memcpy(info->desc, p, len);
+			info->desc[len] = '\0';
+		}
+	}
+
+	if (n != irq.nrirqs)
+		changed = true;
+
+	irq.nrirqs = n;
+
+	return changed;
+}
+
+/*
+ * The deltas of the whole matrix, the current counters becoming the
+ * previous ones
+ */
+static void irq_delta(int n)
+{
+	uint64_t * restrict cur = irq.cur;
+	uint64_t * restrict prev = irq.prev;
+	uint64_t * restrict delta = irq.delta;
+	int i;
+
+	for (i = 0; i < n; i++)
+		delta[i] = cur[i] - prev[i];
+
+	irq.cur = prev;
+	irq.prev = cur;
+}
+
+static int irq_compare(const void *a, const void *b)
+{
+	const struct irq_info *ia = *(struct irq_info * const *)a;
+	const struct irq_info *ib = *(struct irq_info * const *)b;
+
+	if (ia->rate != ib->rate)
+		return ia->rate < ib->rate ? 1 : -1;
+
+	if (ia->total != ib->total)
+		return ia->total < ib->total ? 1 : -1;
+
+	return 0;
+}
+
+static int read_irq_info(void)
+{
+	uint64_t now = time_monotonic_us();
+	struct irq_info **ranked;
+	uint64_t *delta, sum;
+	double seconds;
+	int i, c, changed;
+
+	if (fd_read_buffer(irq_fd, &irq_buf, &irq_size) < 0)
+		return -1;
+
+	/* the interrupts are all changed after a cpu hotplug */
+	if (irq_parse_header(irq_buf) < 0)
+		return -1;
+
+	changed = irq_parse(irq_buf);
+	if (changed < 0)
+		return -1;
+
+	ranked = realloc(irq.ranked, irq.maxirqs * sizeof(*ranked));
+	if (!ranked)
+		return -1;
+	irq.ranked = ranked;
+
+	/* the rates can't be computed when the interrupts changed */
+	if (changed || !irq.sampled)
+		memcpy(irq.prev, irq.cur,
+		       irq.nrirqs * irq.nrcpus * sizeof(*irq.cur));
+
+	irq_delta(irq.nrirqs * irq.nrcpus);
+
+	irq.interval = irq.sampled ? now - irq.sampled : 0;
+	irq.sampled = now;
+	seconds = (double)irq.interval / 1000000;
+
+	for (c = 0; c < irq.nrcpus; c++)
+		irq.cpurate[c] = 0;
+
+	for (i = 0; i < irq.nrirqs; i++) {
+
+		delta = &irq.delta[i * irq.nrcpus];
+		sum = 0;
+
+		for (c = 0; c < irq.nrcpus; c++) {
+			sum += delta[c];
+			if (seconds > 0)
+				irq.cpurate[c] += delta[c] / seconds;
+		}
+
+		irq.irqs[i].rate = seconds > 0 ? sum / seconds : 0;
+
+		/* the counters are in prev after the delta */
+		irq.irqs[i].total = 0;
+		for (c = 0; c < irq.nrcpus; c++)
+			irq.irqs[i].total += irq.prev[i * irq.nrcpus + c];
+
+		irq.ranked[i] = &irq.irqs[i];
+	}
+
+	qsort(irq.ranked, irq.nrirqs, sizeof(*irq.ranked), irq_compare);
+
+	return 0;
+}
+
+/* the cpu with the most interrupts of a line in the last interval */
+static int irq_top_cpu(struct irq_info *info)
+{
+	uint64_t *delta = &irq.delta[(info - irq.irqs) * irq.nrcpus];
+	int c, top = 0;
+
+	for (c = 1; c < irq.nrcpus; c++)
+		if (delta[c] > delta[top])
+			top = c;
+
+	return top;
+}
+
+static int irq_print_header(void)
+{
+	char *buf;
+	int ret;
+
+	if (asprintf(&buf, "%-10s %-12s %-10s %-14s %s", "Irq", "Rate /s",
+		     "Top cpu", "Total", "Description") < 0)
+		return -1;
+
+	ret = display_column_name(buf);
+
+	free(buf);
+
+	return ret;
+}
+
+static int irq_print_cpus(int *line)
+{
+	char *buf;
+	int i, c, top, tmp, *order;
+
+	if (asprintf(&buf, "%-10s %-12s", "Cpu", "Rate /s") < 0)
+		return -1;
+
+	display_print_line(IRQ, (*line)++, buf, 1, NULL);
+	free(buf);
+
+	order = malloc(irq.nrcpus * sizeof(*order));
+	if (!order)
+		return -1;
+
+	for (c = 0; c < irq.nrcpus; c++)
+		order[c] = c;
+
+	for (c = 0; c < irq.nrcpus; c++) {
+
+		/* a selection sort, the busiest cpus first */
+		top = c;
+		for (i = c + 1; i < irq.nrcpus; i++)
+			if (irq.cpurate[order[i]] > irq.cpurate[order[top]])
+				top = i;
+
+		tmp = order[c];
+		order[c] = order[top];
+		order[top] = tmp;
+
+		if (asprintf(&buf, "cpu%-7d %-12.1f", irq.cpus[order[c]],
+			     irq.cpurate[order[c]]) < 0) {
+			free(order);
+			return -1;
+		}
+
+		display_print_line(IRQ, (*line)++, buf, 0, NULL);
+		free(buf);
+	}
+
+	free(order);
+
+	return 0;
+}
+
+static int irq_print_info(void)
+{
+	struct irq_info *info;
+	char *buf;
+	int i, ret = 0, line = 0;
+
+	display_reset_cursor(IRQ);
+
+	irq_print_header();
+
+	for (i = 0; i < irq.nrirqs; i++) {
+
+		info = irq.ranked[i];
+
+		if (asprintf(&buf, "%-10s %-12.1f cpu%-7d %-14llu %s",
+			     info->label, info->rate,
+			     irq.cpus[irq_top_cpu(info)],
+			     (unsigned long long)info->total, info->desc) < 0)
+			return -1;
+
+		display_print_line(IRQ, line++, buf, info->rate > 0, NULL);
+		free(buf);
+	}
+
+	ret = irq_print_cpus(&line);
+
+	display_refresh_pad(IRQ);
+
+	return ret;
+}
+
+static int irq_display(bool refresh)
+{
+	if (irq_error) {
+		display_message(IRQ, "error: " PROC_INTERRUPTS " not readable");
+		return -2;
+	}
+
+	if (refresh && read_irq_info())
+		return -1;
+
+	return irq_print_info();
+}
+
+int irq_dump(void)
+{
+	struct irq_info *info;
+	int i;
+
+	printf("\nInterrupts:\n");
+	printf("***********\n");
+
+	if (read_irq_info())
+		return -1;
+
+	for (i = 0; i < irq.nrirqs; i++) {
+		info = &irq.irqs[i];
+		printf("%s: %llu (%s)\n", info->label,
+		       (unsigned long long)info->total, info->desc);
+	}
+
+	return 0;
+}
+
+int irq_snapshot(struct snapshot *snap)
+{
+	struct irq_info *info;
+	char *path;
+	int i, ret;
+
+	if (read_irq_info())
+		return -1;
+
+	for (i = 0; i < irq.nrirqs; i++) {
+
+		info = &irq.irqs[i];
+
+		if (asprintf(&path, "%s/%s", PROC_INTERRUPTS, info->label) < 0)
+			return -1;
+
+		ret = snapshot_node(snap, path) ||
+			snapshot_string(snap, "description", info->desc);
+
+		free(path);
+
+		if (ret)
+			return -1;
+	}
+
+	return 0;
+}
+
+static struct display_ops irq_ops = {
+	.display = irq_display,
+};
+
+int irq_init(void)
+{
+	int ret;
+
+	ret = display_register(IRQ, &irq_ops);
+	if (ret)
+		printf("error: irq display register failed");
+
+	irq_fd = open(PROC_INTERRUPTS, O_RDONLY | O_CLOEXEC);
+	if (irq_fd < 0) {
+		irq_error = true; /* set the flag */
+		return -1;
+	}
+
+	if (read_irq_info())
+		return -1;
+
+	return ret;
+}
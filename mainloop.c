@@ -18,10 +18,14 @@
 #include <unistd.h>
 #include <sys/epoll.h>
 #include "mainloop.h"
+#include "utils.h"
 
 static int epfd = -1;
 static unsigned short nrhandler;
 
+static mainloop_callback_t timeout_cb;
+static void *timeout_data;
+
 struct mainloop_data {
 	mainloop_callback_t cb;
 	void *data;
@@ -32,18 +36,41 @@ struct mainloop_data **mds;
 
 #define MAX_EVENTS 10
 
+/*
+ * Wait for the events on the file descriptors and call their callbacks.
+ * The timeout callback, if any, is called every 'timeout' milliseconds
+ * whatever the activity on the file descriptors is.
+ *
+ * @timeout : the period in milliseconds of the timeout callback
+ * Returns 0 when a callback asked to exit, -1 on error
+ */
 int mainloop(unsigned int timeout)
 {
-        int i, nfds;
+        int i, nfds, wait = timeout;
         struct epoll_event events[MAX_EVENTS];
 	struct mainloop_data *md;
+	uint64_t now, next;
 
 	if (epfd < 0)
 		return -1;
 
+	next = time_monotonic_us() + (uint64_t)timeout * 1000;
+
 	for (;;) {
 
-                nfds = epoll_wait(epfd, events, MAX_EVENTS, timeout);
+		if (timeout_cb) {
+			now = time_monotonic_us();
+
+			if (now >= next) {
+				next = now + (uint64_t)timeout * 1000;
+				if (timeout_cb(-1, timeout_data) > 0)
+					return 0;
+			}
+
+			wait = (next - now + 999) / 1000;
+		}
+
+                nfds = epoll_wait(epfd, events, MAX_EVENTS, wait);
                 if (nfds < 0) {
                         if (errno == EINTR)
                                 continue;
@@ -107,6 +134,18 @@ int mainloop_del(int fd)
 	return 0;
 }
 
+/*
+ * Set the callback called periodically by the mainloop, the file
+ * descriptor passed to the callback is -1.
+ */
+int mainloop_set_timeout(mainloop_callback_t cb, void *data)
+{
+	timeout_cb = cb;
+	timeout_data = data;
+
+	return 0;
+}
+
 int mainloop_init(void)
 {
         epfd = epoll_create(2);
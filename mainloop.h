@@ -18,5 +18,6 @@ typedef int (*mainloop_callback_t)(int fd, void *data);
 extern int mainloop(unsigned int timeout);
 extern int mainloop_add(int fd, mainloop_callback_t cb, void *data);
 extern int mainloop_del(int fd);
+extern int mainloop_set_timeout(mainloop_callback_t cb, void *data);
 extern int mainloop_init(void);
 extern void mainloop_fini(void);
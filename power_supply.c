@@ -0,0 +1,413 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * The power supplies and the energy drawn from them since start. The
+ * voltage, current and power attributes are sampled through held file
+ * descriptors by a timer of the main loop, at an interval independent
+ * of the refresh one. The power is integrated with the trapezoidal rule
+ * into the charge and the energy consumed, which are compared with the
+ * charge_counter and energy_now deltas given by the fuel gauge. The
+ * energy throughput feeds the energy engine for the average power.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#undef _GNU_SOURCE
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "powerdebug.h"
+#include "display.h"
+#include "mainloop.h"
+#include "power_supply.h"
+#include "tree.h"
+#include "energy.h"
+#include "snapshot.h"
+#include "utils.h"
+
+#define SYSFS_POWER_SUPPLY "/sys/class/power_supply"
+
+/* microamps or microwatts times microseconds in micro-hours */
+#define PS_US_PER_HOUR 3600000000.0
+
+enum ps_attr {
+	PS_VOLTAGE,
+	PS_CURRENT,
+	PS_POWER,
+	PS_CHARGE_COUNTER,
+	PS_ENERGY_NOW,
+	PS_ATTR_MAX,
+};
+
+static const char *ps_attrs[] = {
+	[PS_VOLTAGE]        = "voltage_now",
+	[PS_CURRENT]        = "current_now",
+	[PS_POWER]          = "power_now",
+	[PS_CHARGE_COUNTER] = "charge_counter",
+	[PS_ENERGY_NOW]     = "energy_now",
+};
+
+/*
+ * A power supply
+ *
+ * fds     : the attributes, kept opened, -1 if missing
+ * values  : their last values, in uV, uA, uW, uAh and uWh
+ * start   : the charge_counter and energy_now values at start
+ * current : the current of the last sample, in uA, signed
+ * power   : the power of the last sample, in uW, signed
+ * charge  : the charge consumed since start, integrated, in uAh
+ * energy  : the energy consumed since start, integrated, in uWh
+ * drawn   : the energy drawn or given since start, in uJ
+ * throughput : the engine fed with drawn, for the average power
+ */
+struct ps_info {
+	char type[16];
+	char status[16];
+	int fd_status;
+	int fds[PS_ATTR_MAX];
+	long long values[PS_ATTR_MAX];
+	long long start[PS_ATTR_MAX];
+	double current;
+	double power;
+	double charge;
+	double energy;
+	double drawn;
+	uint64_t sampled;
+	struct energy throughput;
+};
+
+static struct tree *ps_tree;
+static bool ps_error = false;
+
+static const char * const ps_shape[] = { "*", NULL };
+
+static void ps_read_status(struct ps_info *ps)
+{
+	ssize_t len;
+
+	if (ps->fd_status < 0)
+		return;
+
+	len = pread(ps->fd_status, ps->status, sizeof(ps->status) - 1, 0);
+	if (len <= 0)
+		return;
+
+	ps->status[len] = '\0';
+	ps->status[strcspn(ps->status, "\n")] = '\0';
+}
+
+/*
+ * The current and the power, counted as consumed except when charging
+ * as the sign of current_now depends on the driver
+ */
+static void ps_read_power(struct ps_info *ps, double *current, double *power)
+{
+	long long *v = ps->values;
+	int sign = strcmp(ps->status, "Charging") ? 1 : -1;
+
+	*current = sign * llabs(v[PS_CURRENT]);
+
+	if (ps->fds[PS_VOLTAGE] >= 0 && ps->fds[PS_CURRENT] >= 0)
+		*power = *current * v[PS_VOLTAGE] / 1000000;
+	else
+		*power = sign * llabs(v[PS_POWER]);
+}
+
+static inline double ps_abs(double value)
+{
+	return value < 0 ? -value : value;
+}
+
+static int read_ps_cb(struct tree *t, void *data)
+{
+	struct ps_info *ps = t->private;
+	uint64_t *now = data;
+	double current, power, dt;
+	int i;
+
+	if (!t->parent)
+		return 0;
+
+	ps_read_status(ps);
+
+	for (i = 0; i < PS_ATTR_MAX; i++)
+		if (ps->fds[i] >= 0)
+			fd_read_value(ps->fds[i], &ps->values[i]);
+
+	ps_read_power(ps, &current, &power);
+
+	/* the trapezoidal rule between this sample and the previous one */
+	if (ps->sampled) {
+		dt = *now - ps->sampled;
+		ps->charge += (ps->current + current) / 2 * dt / PS_US_PER_HOUR;
+		ps->energy += (ps->power + power) / 2 * dt / PS_US_PER_HOUR;
+		ps->drawn += (ps_abs(ps->power) + ps_abs(power)) / 2 * dt /
+			1000000;
+	} else {
+		memcpy(ps->start, ps->values, sizeof(ps->start));
+	}
+
+	energy_sample(&ps->throughput, ps->drawn, *now);
+
+	ps->current = current;
+	ps->power = power;
+	ps->sampled = *now;
+
+	return 0;
+}
+
+static int read_ps_info(struct tree *tree)
+{
+	uint64_t now = time_monotonic_us();
+
+	return tree_for_each(tree, read_ps_cb, &now);
+}
+
+static int ps_timer(int fd, void *data)
+{
+	uint64_t expirations;
+
+	if (read(fd, &expirations, sizeof(expirations)) < 0)
+		return 0;
+
+	read_ps_info(ps_tree);
+
+	return 0;
+}
+
+/* the consumption given by a fuel gauge attribute since start */
+static inline double ps_delta(struct ps_info *ps, enum ps_attr attr)
+{
+	return ps->start[attr] - ps->values[attr];
+}
+
+static int ps_display_cb(struct tree *t, void *data)
+{
+	struct ps_info *ps = t->private;
+	int *line = data;
+	char counter[16] = "-", gauge[16] = "-";
+	char *buf;
+
+	if (!t->parent)
+		return 0;
+
+	if (ps->fds[PS_CHARGE_COUNTER] >= 0)
+		snprintf(counter, sizeof(counter), "%.2f",
+			 ps_delta(ps, PS_CHARGE_COUNTER) / 1000);
+
+	if (ps->fds[PS_ENERGY_NOW] >= 0)
+		snprintf(gauge, sizeof(gauge), "%.2f",
+			 ps_delta(ps, PS_ENERGY_NOW) / 1000);
+
+	if (asprintf(&buf, "%-16s %-12s %-10.1f %-10.1f %-10.2f %-10s "
+		     "%-10.2f %-10s %s", t->name, ps->status, ps->power / 1000,
+		     energy_power_window(&ps->throughput, ENERGY_WINDOW) / 1000,
+		     ps->charge / 1000, counter, ps->energy / 1000, gauge,
+		     ps->type) < 0)
+		return -1;
+
+	display_print_line(POWER_SUPPLY, *line, buf, 0, t);
+	(*line)++;
+	free(buf);
+
+	return 0;
+}
+
+static int ps_print_header(void)
+{
+	char *buf;
+	int ret;
+
+	if (asprintf(&buf, "%-16s %-12s %-10s %-10s %-10s %-10s %-10s %-10s %s",
+		     "Name", "Status", "Power mW", "Avg mW", "mAh",
+		     "Gauge mAh", "mWh", "Gauge mWh", "Type") < 0)
+		return -1;
+
+	ret = display_column_name(buf);
+
+	free(buf);
+
+	return ret;
+}
+
+static int ps_print_info(struct tree *tree)
+{
+	int ret, line = 0;
+
+	display_reset_cursor(POWER_SUPPLY);
+
+	ps_print_header();
+
+	ret = tree_for_each(tree, ps_display_cb, &line);
+
+	display_refresh_pad(POWER_SUPPLY);
+
+	return ret;
+}
+
+/* the samples are taken by the timer, not at the refresh */
+static int power_supply_display(bool refresh)
+{
+	if (ps_error || !ps_tree) {
+		display_message(POWER_SUPPLY,
+			"error: path " SYSFS_POWER_SUPPLY " not found");
+		return -2;
+	}
+
+	return ps_print_info(ps_tree);
+}
+
+static int ps_dump_cb(struct tree *t, void *data)
+{
+	struct ps_info *ps = t->private;
+	int i;
+
+	if (!t->parent)
+		return 0;
+
+	printf("\n%s:\n", t->name);
+	printf("\ttype: %s\n", ps->type);
+	printf("\tstatus: %s\n", ps->status);
+
+	for (i = 0; i < PS_ATTR_MAX; i++)
+		if (ps->fds[i] >= 0)
+			printf("\t%s: %lld\n", ps_attrs[i], ps->values[i]);
+
+	return 0;
+}
+
+int power_supply_dump(void)
+{
+	printf("\nPower Supplies:\n");
+	printf("***************\n");
+
+	if (read_ps_info(ps_tree))
+		return -1;
+
+	return tree_for_each(ps_tree, ps_dump_cb, NULL);
+}
+
+static int ps_snapshot_cb(struct tree *t, void *data)
+{
+	struct ps_info *ps = t->private;
+	struct snapshot *snap = data;
+
+	if (!t->parent)
+		return 0;
+
+	if (snapshot_node(snap, t->path) ||
+	    snapshot_string(snap, "type", ps->type) ||
+	    snapshot_string(snap, "status", ps->status))
+		return -1;
+
+	return 0;
+}
+
+int power_supply_snapshot(struct snapshot *snap)
+{
+	if (read_ps_info(ps_tree))
+		return -1;
+
+	return tree_for_each(ps_tree, ps_snapshot_cb, snap);
+}
+
+static int fill_ps_cb(struct tree *t, void *data)
+{
+	struct ps_info *ps;
+	int i;
+
+	ps = malloc(sizeof(*ps));
+	if (!ps)
+		return -1;
+	memset(ps, 0, sizeof(*ps));
+	t->private = ps;
+
+	ps->fd_status = -1;
+	for (i = 0; i < PS_ATTR_MAX; i++)
+		ps->fds[i] = -1;
+
+	if (!t->parent)
+		return 0;
+
+	file_read_value(t->path, "type", "%15s", ps->type);
+
+	ps->fd_status = file_open_value(t->path, "status");
+
+	for (i = 0; i < PS_ATTR_MAX; i++)
+		ps->fds[i] = file_open_value(t->path, ps_attrs[i]);
+
+	energy_init(&ps->throughput, 0);
+
+	return 0;
+}
+
+static int ps_timer_init(unsigned int interval)
+{
+	struct itimerspec its = {
+		.it_value = {
+			.tv_sec  = interval / 1000,
+			.tv_nsec = (interval % 1000) * 1000000,
+		},
+	};
+	int fd;
+
+	its.it_interval = its.it_value;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (timerfd_settime(fd, 0, &its, NULL) ||
+	    mainloop_add(fd, ps_timer, NULL)) {
+		close(fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+static struct display_ops power_supply_ops = {
+	.display = power_supply_display,
+};
+
+int power_supply_init(unsigned int interval)
+{
+	int ret;
+
+	ret = display_register(POWER_SUPPLY, &power_supply_ops);
+	if (ret)
+		printf("error: power supply display register failed");
+
+	if (access(SYSFS_POWER_SUPPLY, F_OK)) {
+		ps_error = true; /* set the flag */
+		return -1;
+	}
+
+	ps_tree = tree_load_shape(SYSFS_POWER_SUPPLY, ps_shape, true);
+	if (!ps_tree)
+		return -1;
+
+	if (tree_for_each(ps_tree, fill_ps_cb, NULL))
+		return -1;
+
+	if (read_ps_info(ps_tree))
+		return -1;
+
+	if (ps_timer_init(interval ? interval : POWER_SUPPLY_INTERVAL))
+		return -1;
+
+	return ret;
+}
@@ -0,0 +1,20 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+struct snapshot;
+
+/* The default sampling interval of the power supplies, in milliseconds */
+#define POWER_SUPPLY_INTERVAL 250
+
+extern int power_supply_init(unsigned int interval);
+extern int power_supply_dump(void);
+extern int power_supply_snapshot(struct snapshot *snap);
@@ -0,0 +1,482 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * The powercap zones, as the RAPL domains, give an energy counter per
+ * zone. The power of a zone is derived from the counter with the energy
+ * engine, the counter wrapping at max_energy_range_uj.
+ *
+ * The zones are links in the class directory, named after their parent
+ * zone: intel-rapl:0:1 is a subzone of the package intel-rapl:0. They
+ * are loaded as a flat list and moved below their parent.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#undef _GNU_SOURCE
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "powerdebug.h"
+#include "display.h"
+#include "powercap.h"
+#include "tree.h"
+#include "snapshot.h"
+#include "energy.h"
+#include "utils.h"
+
+#define SYSFS_POWERCAP "/sys/class/powercap"
+
+/* The number of constraints showed per zone */
+#define POWERCAP_CONSTRAINTS 2
+
+struct powercap_constraint {
+	char name[NAME_MAX];
+	long long power_limit;
+	long long time_window;
+};
+
+/*
+ * A powercap zone
+ *
+ * name        : the zone name, eg. package-0, core, dram
+ * fd          : the energy_uj attribute, kept opened
+ * energy      : the power derived from energy_uj
+ * constraints : the power limits of the zone
+ */
+struct powercap_info {
+	char name[NAME_MAX];
+	int fd;
+	struct energy energy;
+	int nrconstraints;
+	struct powercap_constraint constraints[POWERCAP_CONSTRAINTS];
+};
+
+static struct tree *powercap_tree;
+static bool powercap_error = false;
+
+/* the zones, the control types as intel-rapl have no ':' */
+static const char * const powercap_shape[] = { "*:*", NULL };
+
+static inline double powercap_watts(double uw)
+{
+	return uw / 1000000;
+}
+
+static int read_powercap_cb(struct tree *t, void *data)
+{
+	struct powercap_info *pc = t->private;
+	uint64_t *now = data;
+	long long value;
+
+	if (!t->parent || pc->fd < 0)
+		return 0;
+
+	if (fd_read_value(pc->fd, &value))
+		return 0;
+
+	energy_sample(&pc->energy, value, *now);
+
+	return 0;
+}
+
+static int read_powercap_info(struct tree *tree)
+{
+	uint64_t now = time_monotonic_us();
+
+	return tree_for_each(tree, read_powercap_cb, &now);
+}
+
+/*
+ * The power of the subzones of a zone, the remaining of the zone power
+ * being consumed by what is not covered by a subzone.
+ */
+static double powercap_children_power(struct tree *t)
+{
+	struct powercap_info *pc;
+	double power = 0;
+
+	for (t = t->child; t; t = t->next) {
+		pc = t->private;
+		power += energy_power(&pc->energy);
+	}
+
+	return power;
+}
+
+static int powercap_display_cb(struct tree *t, void *data)
+{
+	struct powercap_info *pc = t->private;
+	int *line = data;
+	char *name, *buf, subzones[16] = "", limit[16] = "";
+	int ret;
+
+	if (!t->parent)
+		return 0;
+
+	if (asprintf(&name, "%*s%s", (t->depth - 1) * 2, "", pc->name) < 0)
+		return -1;
+
+	if (t->child)
+		snprintf(subzones, sizeof(subzones), "%.3f",
+			 powercap_watts(powercap_children_power(t)));
+
+	if (pc->nrconstraints)
+		snprintf(limit, sizeof(limit), "%.3f",
+			 powercap_watts(pc->constraints[0].power_limit));
+
+	if (pc->fd < 0)
+		ret = asprintf(&buf, "%-23s %-18s %s", name, t->name,
+			       "energy_uj not readable");
+	else
+		ret = asprintf(&buf, "%-23s %-18s %-10.3f %-10.3f %-11s "
+			       "%-11s %s", name, t->name,
+			       powercap_watts(energy_power(&pc->energy)),
+			       powercap_watts(energy_power_window(&pc->energy,
+								  ENERGY_WINDOW)),
+			       subzones,
+			       pc->nrconstraints ? pc->constraints[0].name : "",
+			       limit);
+	free(name);
+	if (ret < 0)
+		return -1;
+
+	display_print_line(POWERCAP, *line, buf, !t->parent->parent, t);
+
+	(*line)++;
+
+	free(buf);
+
+	return 0;
+}
+
+static int powercap_print_header(void)
+{
+	char *buf;
+	int ret;
+
+	if (asprintf(&buf, "%-23s %-18s %-10s %-10s %-11s %-11s %s",
+		     "Name", "Zone", "Power W", "Avg W", "Subzones W",
+		     "Constraint", "Limit W") < 0)
+		return -1;
+
+	ret = display_column_name(buf);
+
+	free(buf);
+
+	return ret;
+}
+
+/*
+ * The control type of a top level zone is the beginning of its
+ * directory name, eg. intel-rapl for intel-rapl:0
+ */
+static size_t powercap_control_type(struct tree *t)
+{
+	return strcspn(t->name, ":");
+}
+
+static bool powercap_is_package(struct tree *t)
+{
+	struct powercap_info *pc = t->private;
+
+	return !strncmp(pc->name, "package-", strlen("package-"));
+}
+
+/*
+ * The control type whose packages are rolled up. A package can be
+ * exposed by several control types, as intel-rapl and intel-rapl-mmio,
+ * the first one in alphabetical order is used.
+ */
+static struct tree *powercap_rollup_type(struct tree *tree)
+{
+	struct tree *t, *type = NULL;
+	size_t len, typelen = 0;
+	int cmp;
+
+	for (t = tree->child; t; t = t->next) {
+
+		if (!powercap_is_package(t))
+			continue;
+
+		len = powercap_control_type(t);
+
+		if (type) {
+			cmp = strncmp(t->name, type->name,
+				      len < typelen ? len : typelen);
+			if (cmp > 0 || (!cmp && len >= typelen))
+				continue;
+		}
+
+		type = t;
+		typelen = len;
+	}
+
+	return type;
+}
+
+/*
+ * Show the zones and, as a rollup, the power of all the packages
+ */
+static int powercap_print_info(struct tree *tree)
+{
+	struct powercap_info *pc;
+	struct tree *t, *type;
+	double power = 0, average = 0;
+	char *buf;
+	size_t len;
+	int ret, line = 0;
+
+	display_reset_cursor(POWERCAP);
+
+	powercap_print_header();
+
+	ret = tree_for_each(tree, powercap_display_cb, &line);
+	if (ret)
+		goto out;
+
+	/* psys and the mmio duplicates would count a package twice */
+	type = powercap_rollup_type(tree);
+	len = type ? powercap_control_type(type) : 0;
+
+	for (t = tree->child; t; t = t->next) {
+
+		if (!powercap_is_package(t) ||
+		    powercap_control_type(t) != len ||
+		    strncmp(t->name, type->name, len))
+			continue;
+
+		pc = t->private;
+		power += energy_power(&pc->energy);
+		average += energy_power_window(&pc->energy, ENERGY_WINDOW);
+	}
+
+	ret = -1;
+	if (asprintf(&buf, "%-23s %-18s %-10.3f %-10.3f", "all packages", "",
+		     powercap_watts(power), powercap_watts(average)) < 0)
+		goto out;
+
+	display_print_line(POWERCAP, line, buf, 1, NULL);
+	free(buf);
+	ret = 0;
+out:
+	display_refresh_pad(POWERCAP);
+
+	return ret;
+}
+
+static int powercap_display(bool refresh)
+{
+	if (powercap_error || !powercap_tree) {
+		display_message(POWERCAP,
+			"error: path " SYSFS_POWERCAP " not found");
+		return -2;
+	}
+
+	if (refresh && read_powercap_info(powercap_tree))
+		return -1;
+
+	return powercap_print_info(powercap_tree);
+}
+
+static int powercap_dump_cb(struct tree *t, void *data)
+{
+	struct powercap_info *pc = t->private;
+	int i;
+
+	if (!t->parent)
+		return 0;
+
+	printf("%*s%s (%s):\n", (t->depth - 1) * 2, "", t->name, pc->name);
+
+	if (pc->fd >= 0)
+		printf("%*s\tpower: %.3f W\n", (t->depth - 1) * 2, "",
+		       powercap_watts(energy_power(&pc->energy)));
+
+	for (i = 0; i < pc->nrconstraints; i++)
+		printf("%*s\t%s: %.3f W, %lld us\n", (t->depth - 1) * 2, "",
+		       pc->constraints[i].name,
+		       powercap_watts(pc->constraints[i].power_limit),
+		       pc->constraints[i].time_window);
+
+	return 0;
+}
+
+/*
+ * Dump the zones, the power is measured over a tenth of a second
+ */
+int powercap_dump(void)
+{
+	printf("\nPowercap Information:\n");
+	printf("*********************\n\n");
+
+	if (read_powercap_info(powercap_tree))
+		return -1;
+
+	usleep(100000);
+
+	if (read_powercap_info(powercap_tree))
+		return -1;
+
+	return tree_for_each(powercap_tree, powercap_dump_cb, NULL);
+}
+
+static int powercap_snapshot_cb(struct tree *t, void *data)
+{
+	struct snapshot *snap = data;
+	struct powercap_info *pc = t->private;
+	char name[NAME_MAX + 32];
+	int i;
+
+	if (!t->parent)
+		return 0;
+
+	if (snapshot_node(snap, t->path) ||
+	    snapshot_string(snap, "name", pc->name))
+		return -1;
+
+	for (i = 0; i < pc->nrconstraints; i++) {
+		snprintf(name, sizeof(name), "%s_power_limit_uw",
+			 pc->constraints[i].name);
+		if (snapshot_int(snap, name, pc->constraints[i].power_limit))
+			return -1;
+	}
+
+	return 0;
+}
+
+int powercap_snapshot(struct snapshot *snap)
+{
+	return tree_for_each(powercap_tree, powercap_snapshot_cb, snap);
+}
+
+static int fill_powercap_cb(struct tree *t, void *data)
+{
+	struct powercap_info *pc;
+	struct powercap_constraint *c;
+	long long range = 0;
+	char attr[64];
+	int i;
+
+	pc = malloc(sizeof(*pc));
+	if (!pc)
+		return -1;
+	memset(pc, 0, sizeof(*pc));
+	pc->fd = -1;
+	t->private = pc;
+
+	if (!t->parent)
+		return 0;
+
+	file_read_value(t->path, "name", "%s", pc->name);
+	file_read_value(t->path, "max_energy_range_uj", "%lld", &range);
+
+	energy_init(&pc->energy, range);
+
+	/* the counter is only readable by root on recent kernels */
+	pc->fd = file_open_value(t->path, "energy_uj");
+
+	for (i = 0; i < POWERCAP_CONSTRAINTS; i++) {
+
+		c = &pc->constraints[pc->nrconstraints];
+
+		snprintf(attr, sizeof(attr), "constraint_%d_name", i);
+		if (file_read_value(t->path, attr, "%s", c->name))
+			break;
+
+		snprintf(attr, sizeof(attr), "constraint_%d_power_limit_uw", i);
+		file_read_value(t->path, attr, "%lld", &c->power_limit);
+
+		snprintf(attr, sizeof(attr), "constraint_%d_time_window_us", i);
+		file_read_value(t->path, attr, "%lld", &c->time_window);
+
+		pc->nrconstraints++;
+	}
+
+	return 0;
+}
+
+/*
+ * Move the subzones below their parent zone, the parent of a zone is
+ * named after the zone without its last ':' suffix.
+ */
+static int powercap_hierarchy(void)
+{
+	struct tree **zones, *t, *parent;
+	char name[NAME_MAX], *p;
+	int i, nr = powercap_tree->nrchild;
+
+	zones = malloc(sizeof(*zones) * nr);
+	if (!zones)
+		return -1;
+
+	for (i = 0, t = powercap_tree->child; t && i < nr; t = t->next)
+		zones[i++] = t;
+
+	for (i = 0; i < nr; i++) {
+
+		strncpy(name, zones[i]->name, sizeof(name) - 1);
+		name[sizeof(name) - 1] = '\0';
+
+		p = strrchr(name, ':');
+		if (!p)
+			continue;
+		*p = '\0';
+
+		/* a package zone, its parent is the control type */
+		if (!strchr(name, ':'))
+			continue;
+
+		parent = tree_find(powercap_tree, name);
+		if (parent && parent != zones[i])
+			tree_move(zones[i], parent);
+	}
+
+	free(zones);
+
+	return tree_index(powercap_tree);
+}
+
+static struct display_ops powercap_ops = {
+	.display = powercap_display,
+};
+
+int powercap_init(void)
+{
+	int ret;
+
+	ret = display_register(POWERCAP, &powercap_ops);
+	if (ret)
+		printf("error: powercap display register failed");
+
+	if (access(SYSFS_POWERCAP, F_OK)) {
+		powercap_error = true; /* set the flag */
+		return -1;
+	}
+
+	powercap_tree = tree_load_shape(SYSFS_POWERCAP, powercap_shape, true);
+	if (!powercap_tree)
+		return -1;
+
+	if (powercap_hierarchy())
+		return -1;
+
+	if (tree_for_each(powercap_tree, fill_powercap_cb, NULL))
+		return -1;
+
+	if (read_powercap_info(powercap_tree))
+		return -1;
+
+	return ret;
+}
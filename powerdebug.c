@@ -21,12 +21,26 @@
 #include <errno.h>
 #include <ncurses.h>
 #include <signal.h>
+#include <limits.h>
 #include "regulator.h"
 #include "display.h"
 #include "clocks.h"
 #include "sensor.h"
 #include "gpio.h"
+#include "powercap.h"
+#include "thermal.h"
+#include "cpufreq.h"
+#include "cpuidle.h"
+#include "devfreq.h"
+#include "genpd.h"
+#include "runtime_pm.h"
+#include "wakeup.h"
+#include "irq.h"
+#include "suspend.h"
+#include "power_supply.h"
 #include "mainloop.h"
+#include "bench.h"
+#include "snapshot.h"
 #include "powerdebug.h"
 
 extern void sigwinch_handler(int);
@@ -41,12 +55,40 @@ void usage(void)
 	printf("  -r, --regulator 	Show regulator information\n");
 	printf("  -s, --sensor		Show sensor information\n");
 	printf("  -c, --clock		Show clock information\n");
+	printf("  --powercap		Show powercap zones information\n");
+	printf("  --thermal		Show thermal zones and cooling devices\n");
+	printf("  --cpufreq		Show cpufreq residency information\n");
+	printf("  --cpuidle		Show cpuidle residency information\n");
+	printf("  --devfreq		Show devfreq and interconnect information\n");
+	printf("  --genpd		Show the generic power domains\n");
+	printf("  --runtime-pm		Show the runtime power management of the devices\n");
+	printf("  --wakeup		Show the wakeup sources\n");
+	printf("  --irq			Show the interrupt rates\n");
+	printf("  --suspend		Show the suspend statistics\n");
+	printf("  --power-supply	Show the power supplies and the energy consumed\n");
+	printf("  --supply-interval	Set the power supplies sampling interval"
+		" in seconds (eg. 0.25)\n");
+	printf("  -L, --lazy		Load and read the clocks when showed"
+		" only\n");
 	printf("  -p, --findparents	Show all parents for a particular"
 		" clock\n");
 	printf("  -t, --time		Set ticktime in seconds (eg. 10.0)\n");
+	printf("  -l, --lowbw		Low bandwidth mode for slow serial"
+		" consoles\n");
+	printf("  -f, --fps		Maximum number of frames per second"
+		" (0 for no limit)\n");
 	printf("  -d, --dump		Dump information once (no refresh)\n");
 	printf("  -v, --verbose		Verbose mode (use with -r and/or"
 		" -s)\n");
+	printf("  -b, --benchmark	Render the clock panel <n> times on"
+		" a synthetic tree\n");
+	printf("  -S, --snapshot	Save the state of all the subsystems"
+		" in <file>\n");
+	printf("  -D, --diff		Compare the snapshots <file1> and"
+		" <file2>\n");
+	printf("  --clock-subtree		Dump the subtree of <clock-name>\n");
+	printf("  --clock-lca		Show the common parent of <clock1>"
+		" and <clock2>\n");
 	printf("  -V, --version		Show Version\n");
 	printf("  -h, --help 		Help\n");
 }
@@ -62,24 +104,80 @@ void version()
  * -s, --sensor	 	: sensors
  * -c, --clock	  	: clocks
  * -g, --gpio           : gpios
+ * --powercap		: powercap zones
+ * --thermal		: thermal zones and cooling devices
+ * --cpufreq		: cpufreq residency information
+ * --cpuidle		: cpuidle residency information
+ * --devfreq		: devfreq and interconnect information
+ * --genpd		: the generic power domains
+ * --runtime-pm		: the runtime power management of the devices
+ * --wakeup		: the wakeup sources
+ * --irq		: the interrupt rates
+ * --suspend		: the suspend statistics
+ * --power-supply	: the power supplies and the energy consumed
+ * --supply-interval	: power supplies sampling interval
+ * -L, --lazy		: lazy clock tree
  * -p, --findparents    : clockname whose parents have to be found
  * -t, --time		: ticktime
+ * -f, --fps		: frame rate limit
+ * -l, --lowbw		: low bandwidth mode
  * -d, --dump		: dump
  * -v, --verbose	: verbose
+ * -b, --benchmark	: display benchmark
+ * -S, --snapshot	: snapshot file
+ * -D, --diff		: compare two snapshot files
  * -V, --version	: version
  * -h, --help		: help
  * no option / default : show usage!
  */
 
+/* long only options */
+enum {
+	OPT_CLOCK_SUBTREE = 256,
+	OPT_CLOCK_LCA,
+	OPT_POWERCAP,
+	OPT_THERMAL,
+	OPT_CPUFREQ,
+	OPT_CPUIDLE,
+	OPT_DEVFREQ,
+	OPT_GENPD,
+	OPT_RUNTIME_PM,
+	OPT_WAKEUP,
+	OPT_IRQ,
+	OPT_SUSPEND,
+	OPT_POWER_SUPPLY,
+	OPT_SUPPLY_INTERVAL,
+};
+
 static struct option long_options[] = {
 	{ "regulator", 0, 0, 'r' },
 	{ "sensor", 0, 0, 's' },
 	{ "clock",  0, 0, 'c' },
 	{ "gpio",  0, 0, 'g' },
+	{ "powercap", 0, 0, OPT_POWERCAP },
+	{ "thermal", 0, 0, OPT_THERMAL },
+	{ "cpufreq", 0, 0, OPT_CPUFREQ },
+	{ "cpuidle", 0, 0, OPT_CPUIDLE },
+	{ "devfreq", 0, 0, OPT_DEVFREQ },
+	{ "genpd", 0, 0, OPT_GENPD },
+	{ "runtime-pm", 0, 0, OPT_RUNTIME_PM },
+	{ "wakeup", 0, 0, OPT_WAKEUP },
+	{ "irq", 0, 0, OPT_IRQ },
+	{ "suspend", 0, 0, OPT_SUSPEND },
+	{ "power-supply", 0, 0, OPT_POWER_SUPPLY },
+	{ "supply-interval", 1, 0, OPT_SUPPLY_INTERVAL },
+	{ "lazy", 0, 0, 'L' },
 	{ "findparents", 1, 0, 'p' },
 	{ "time", 1, 0, 't' },
+	{ "fps", 1, 0, 'f' },
+	{ "lowbw", 0, 0, 'l' },
 	{ "dump", 0, 0, 'd' },
 	{ "verbose", 0, 0, 'v' },
+	{ "benchmark", 1, 0, 'b' },
+	{ "snapshot", 1, 0, 'S' },
+	{ "diff", 1, 0, 'D' },
+	{ "clock-subtree", 1, 0, OPT_CLOCK_SUBTREE },
+	{ "clock-lca", 1, 0, OPT_CLOCK_LCA },
 	{ "version", 0, 0, 'V' },
 	{ "help", 0, 0, 'h' },
 	{ 0, 0, 0, 0 }
@@ -91,24 +189,47 @@ struct powerdebug_options {
 	bool sensors;
 	bool clocks;
 	bool gpios;
+	bool powercap;
+	bool thermal;
+	bool cpufreq;
+	bool cpuidle;
+	bool devfreq;
+	bool genpd;
+	bool runtime_pm;
+	bool wakeup;
+	bool irq;
+	bool suspend;
+	bool power_supply;
 	bool dump;
-	unsigned int ticktime;
+	bool lowbw;
+	bool lazy;
+	unsigned int ticktime;	/* milliseconds */
+	unsigned int supply_interval;	/* milliseconds */
+	unsigned int fps;
+	unsigned int benchmark;
 	int selectedwindow;
 	char *clkname;
+	char *snapshot;
+	char *diff[2];
+	char *subtree;
+	char *lca[2];
 };
 
 int getoptions(int argc, char *argv[], struct powerdebug_options *options)
 {
+	double interval;
+	char *end;
 	int c;
 
 	memset(options, 0, sizeof(*options));
-	options->ticktime = 10;
+	options->ticktime = 10000;
+	options->fps = DISPLAY_DEFAULT_FPS;
 	options->selectedwindow = -1;
 
 	while (1) {
 		int optindex = 0;
 
-		c = getopt_long(argc, argv, "rscgp:t:dvVh",
+		c = getopt_long(argc, argv, "rscgLp:t:f:ldvb:S:D:Vh",
 				long_options, &optindex);
 		if (c == -1)
 			break;
@@ -130,6 +251,61 @@ int getoptions(int argc, char *argv[], struct powerdebug_options *options)
 			options->gpios = true;
 			options->selectedwindow = GPIO;
 			break;
+		case OPT_POWERCAP:
+			options->powercap = true;
+			options->selectedwindow = POWERCAP;
+			break;
+		case OPT_THERMAL:
+			options->thermal = true;
+			options->selectedwindow = THERMAL;
+			break;
+		case OPT_CPUFREQ:
+			options->cpufreq = true;
+			options->selectedwindow = CPUFREQ;
+			break;
+		case OPT_CPUIDLE:
+			options->cpuidle = true;
+			options->selectedwindow = CPUIDLE;
+			break;
+		case OPT_DEVFREQ:
+			options->devfreq = true;
+			options->selectedwindow = DEVFREQ;
+			break;
+		case OPT_GENPD:
+			options->genpd = true;
+			options->selectedwindow = GENPD;
+			break;
+		case OPT_RUNTIME_PM:
+			options->runtime_pm = true;
+			options->selectedwindow = RUNTIME_PM;
+			break;
+		case OPT_WAKEUP:
+			options->wakeup = true;
+			options->selectedwindow = WAKEUP;
+			break;
+		case OPT_IRQ:
+			options->irq = true;
+			options->selectedwindow = IRQ;
+			break;
+		case OPT_SUSPEND:
+			options->suspend = true;
+			options->selectedwindow = SUSPEND;
+			break;
+		case OPT_POWER_SUPPLY:
+			options->power_supply = true;
+			options->selectedwindow = POWER_SUPPLY;
+			break;
+		case OPT_SUPPLY_INTERVAL:
+			/* a null interval would disarm the timer */
+			interval = strtod(optarg, &end);
+			if (end == optarg || *end || !(interval >= 0.001) ||
+			    interval > UINT_MAX / 1000)
+				return -1;
+			options->supply_interval = interval * 1000;
+			break;
+		case 'L':
+			options->lazy = true;
+			break;
 		case 'p':
 			options->clkname = strdup(optarg);
 			if (!options->clkname) {
@@ -140,7 +316,13 @@ int getoptions(int argc, char *argv[], struct powerdebug_options *options)
 			options->clocks = true;
 			break;
 		case 't':
-			options->ticktime = atoi(optarg);
+			options->ticktime = atof(optarg) * 1000;
+			break;
+		case 'l':
+			options->lowbw = true;
+			break;
+		case 'f':
+			options->fps = atoi(optarg);
 			break;
 		case 'd':
 			options->dump = true;
@@ -148,6 +330,33 @@ int getoptions(int argc, char *argv[], struct powerdebug_options *options)
 		case 'v':
 			options->verbose = true;
 			break;
+		case 'b':
+			options->benchmark = atoi(optarg);
+			break;
+		case 'S':
+			options->snapshot = optarg;
+			break;
+		case 'D':
+			/* the second file is the next argument */
+			if (optind >= argc)
+				return -1;
+			options->diff[0] = optarg;
+			options->diff[1] = argv[optind++];
+			break;
+		case OPT_CLOCK_SUBTREE:
+			options->subtree = optarg;
+			options->dump = true;
+			options->clocks = true;
+			break;
+		case OPT_CLOCK_LCA:
+			/* the second clock is the next argument */
+			if (optind >= argc)
+				return -1;
+			options->lca[0] = optarg;
+			options->lca[1] = argv[optind++];
+			options->dump = true;
+			options->clocks = true;
+			break;
 		case 'V':
 			version();
 			break;
@@ -161,9 +370,30 @@ int getoptions(int argc, char *argv[], struct powerdebug_options *options)
 
 	/* No system specified to be dump, let's default to all */
 	if (!options->regulators && !options->clocks &&
-	    !options->sensors && !options->gpios)
+	    !options->sensors && !options->gpios && !options->powercap &&
+	    !options->thermal &&
+	    !options->cpufreq &&
+	    !options->cpuidle &&
+	    !options->devfreq &&
+	    !options->genpd &&
+	    !options->runtime_pm &&
+	    !options->wakeup &&
+	    !options->irq &&
+	    !options->suspend &&
+	    !options->power_supply)
 		options->regulators = options->clocks =
-			options->sensors = options->gpios = true;
+			options->sensors = options->gpios =
+			options->powercap =
+			options->thermal =
+			options->cpufreq =
+			options->cpuidle =
+			options->devfreq =
+			options->genpd =
+			options->runtime_pm =
+			options->wakeup =
+			options->irq =
+			options->suspend =
+			options->power_supply = true;
 
 	if (options->selectedwindow == -1)
 		options->selectedwindow = CLOCK;
@@ -176,8 +406,14 @@ static int powerdebug_dump(struct powerdebug_options *options)
 	if (options->regulators)
 		regulator_dump();
 
-	if (options->clocks)
-		clock_dump(options->clkname);
+	if (options->clocks) {
+		if (options->subtree)
+			clock_dump_subtree(options->subtree);
+		else if (options->lca[0])
+			clock_dump_lca(options->lca[0], options->lca[1]);
+		else
+			clock_dump(options->clkname);
+	}
 
 	if (options->sensors)
 		sensor_dump();
@@ -185,17 +421,186 @@ static int powerdebug_dump(struct powerdebug_options *options)
 	if (options->gpios)
 		gpio_dump();
 
+	if (options->powercap)
+		powercap_dump();
+
+	if (options->thermal)
+		thermal_dump();
+
+	if (options->cpufreq)
+		cpufreq_dump();
+
+	if (options->cpuidle)
+		cpuidle_dump();
+
+	if (options->devfreq)
+		devfreq_dump();
+
+	if (options->genpd)
+		genpd_dump();
+
+	if (options->runtime_pm)
+		runtime_pm_dump();
+
+	if (options->wakeup)
+		wakeup_dump();
+
+	if (options->irq)
+		irq_dump();
+
+	if (options->suspend)
+		suspend_dump();
+
+	if (options->power_supply)
+		power_supply_dump();
+
 	return 0;
 }
 
+static int powerdebug_snapshot(struct powerdebug_options *options)
+{
+	struct snapshot *snap;
+	int ret = -1;
+
+	snap = snapshot_alloc();
+	if (!snap)
+		return -1;
+
+	if (options->regulators && regulator_snapshot(snap))
+		goto out;
+
+	if (options->clocks && clock_snapshot(snap))
+		goto out;
+
+	if (options->sensors && sensor_snapshot(snap))
+		goto out;
+
+	if (options->gpios && gpio_snapshot(snap))
+		goto out;
+
+	if (options->powercap && powercap_snapshot(snap))
+		goto out;
+
+	if (options->thermal && thermal_snapshot(snap))
+		goto out;
+
+	if (options->cpufreq && cpufreq_snapshot(snap))
+		goto out;
+
+	if (options->cpuidle && cpuidle_snapshot(snap))
+		goto out;
+
+	if (options->devfreq && devfreq_snapshot(snap))
+		goto out;
+
+	if (options->genpd && genpd_snapshot(snap))
+		goto out;
+
+	if (options->runtime_pm && runtime_pm_snapshot(snap))
+		goto out;
+
+	if (options->wakeup && wakeup_snapshot(snap))
+		goto out;
+
+	if (options->irq && irq_snapshot(snap))
+		goto out;
+
+	if (options->suspend && suspend_snapshot(snap))
+		goto out;
+
+	if (options->power_supply && power_supply_snapshot(snap))
+		goto out;
+
+	ret = snapshot_write(snap, options->snapshot);
+	if (ret)
+		fprintf(stderr, "failed to write the snapshot %s\n",
+			options->snapshot);
+	else
+		printf("%u nodes saved in %s\n", snapshot_nrnodes(snap),
+		       options->snapshot);
+out:
+	snapshot_free(snap);
+	return ret;
+}
+
+/*
+ * The state compared from a suspend cycle to the next one: the clocks,
+ * the regulators and the gpios which are showed
+ */
+static int powerdebug_suspend_capture(struct snapshot *snap, void *data)
+{
+	struct powerdebug_options *options = data;
+
+	if (options->regulators && regulator_snapshot(snap))
+		return -1;
+
+	if (options->clocks && clock_snapshot(snap))
+		return -1;
+
+	if (options->gpios && gpio_snapshot(snap))
+		return -1;
+
+	return 0;
+}
+
+static int powerdebug_diff_cb(enum snapshot_change change, const char *path,
+			      const char *attr, const char *old,
+			      const char *new, void *data)
+{
+	switch (change) {
+	case SNAPSHOT_ADDED:
+		printf("+ %s\n", path);
+		break;
+	case SNAPSHOT_REMOVED:
+		printf("- %s\n", path);
+		break;
+	case SNAPSHOT_CHANGED:
+		printf("~ %s %s: %s -> %s\n", path, attr,
+		       old ? old : "(none)", new ? new : "(none)");
+		break;
+	}
+
+	return 0;
+}
+
+static int powerdebug_diff(struct powerdebug_options *options)
+{
+	struct snapshot *a, *b;
+	int ret = -1;
+
+	a = snapshot_read(options->diff[0]);
+	if (!a) {
+		fprintf(stderr, "failed to read the snapshot %s\n",
+			options->diff[0]);
+		return -1;
+	}
+
+	b = snapshot_read(options->diff[1]);
+	if (!b) {
+		fprintf(stderr, "failed to read the snapshot %s\n",
+			options->diff[1]);
+		goto out;
+	}
+
+	ret = snapshot_diff(a, b, powerdebug_diff_cb, NULL);
+
+	snapshot_free(b);
+out:
+	snapshot_free(a);
+	return ret;
+}
+
 static int powerdebug_display(struct powerdebug_options *options)
 {
+	display_set_framerate(options->fps);
+	display_set_lowbw(options->lowbw);
+
 	if (display_init(options->selectedwindow)) {
 		printf("failed to initialize display\n");
 		return -1;
 	}
 
-	if (mainloop(options->ticktime * 1000))
+	if (mainloop(options->ticktime))
 		return -1;
 
 	return 0;
@@ -241,6 +646,12 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	if (options->benchmark)
+		return benchmark(options->benchmark, options->verbose) < 0;
+
+	if (options->diff[0])
+		return powerdebug_diff(options) < 0;
+
 	if (mainloop_init()) {
 		fprintf(stderr, "failed to initialize the mainloop\n");
 		return 1;
@@ -251,6 +662,9 @@ int main(int argc, char **argv)
 		options->regulators = false;
 	}
 
+	/* the dump and the snapshot need the whole tree */
+	clock_set_lazy(options->lazy && !options->dump && !options->snapshot);
+
 	if (clock_init()) {
 		printf("failed to initialize clock details (check debugfs)\n");
 		options->clocks = false;
@@ -266,8 +680,73 @@ int main(int argc, char **argv)
 		options->gpios = false;
 	}
 
-	ret = options->dump ? powerdebug_dump(options) :
-		powerdebug_display(options);
+	if (powercap_init()) {
+		printf("failed to initialize powercap\n");
+		options->powercap = false;
+	}
+
+	if (thermal_init()) {
+		printf("failed to initialize thermal\n");
+		options->thermal = false;
+	}
+
+	if (cpufreq_init()) {
+		printf("failed to initialize cpufreq\n");
+		options->cpufreq = false;
+	}
+
+	if (cpuidle_init()) {
+		printf("failed to initialize cpuidle\n");
+		options->cpuidle = false;
+	}
+
+	if (devfreq_init()) {
+		printf("failed to initialize devfreq\n");
+		options->devfreq = false;
+	}
+
+	if (genpd_init()) {
+		printf("failed to initialize genpd\n");
+		options->genpd = false;
+	}
+
+	/*
+	 * The runtime pm scan walks the whole device tree, the suspend and
+	 * the power supply panels sample on their own timers: they are
+	 * only initialized when showed
+	 */
+	if (options->runtime_pm && runtime_pm_init()) {
+		printf("failed to initialize runtime pm\n");
+		options->runtime_pm = false;
+	}
+
+	if (wakeup_init()) {
+		printf("failed to initialize wakeup\n");
+		options->wakeup = false;
+	}
+
+	if (irq_init()) {
+		printf("failed to initialize irq\n");
+		options->irq = false;
+	}
+
+	if (options->suspend &&
+	    suspend_init(powerdebug_suspend_capture, options)) {
+		printf("failed to initialize suspend\n");
+		options->suspend = false;
+	}
+
+	if (options->power_supply &&
+	    power_supply_init(options->supply_interval)) {
+		printf("failed to initialize power supply\n");
+		options->power_supply = false;
+	}
+
+	if (options->snapshot)
+		ret = powerdebug_snapshot(options);
+	else
+		ret = options->dump ? powerdebug_dump(options) :
+			powerdebug_display(options);
 
 	return ret < 0;
 }
@@ -29,10 +29,12 @@
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <limits.h>
 
 #include "display.h"
 #include "powerdebug.h"
 #include "tree.h"
+#include "snapshot.h"
 #include "utils.h"
 
 struct regulator_info {
@@ -49,6 +51,12 @@ struct regulator_info {
 	int max_microamps;
 	int requested_microamps;
 	int num_users;
+	bool expanded;
+	/* estimated power in uW, microvolts x microamps */
+	long long power;
+	/* the regulator and the ones it supplies */
+	int total_users;
+	long long total_power;
 };
 
 struct regulator_data {
@@ -92,6 +100,9 @@ static int regulator_dump_cb(struct tree *tree, void *data)
 	if (!strncmp("regulator.", tree->name, strlen("regulator.")))
 		printf("\n%s:\n", tree->name);
 
+	if (tree->parent && tree->parent->parent)
+		printf("\tsupply: %s\n", tree->parent->name);
+
 	for (i = 0; i < nregdata; i++) {
 		int val;
 
@@ -121,7 +132,8 @@ static int regulator_display_cb(struct tree *t, void *data)
 {
 	struct regulator_info *reg = t->private;
 	int *line = data;
-	char *buf;
+	char *buf, *name;
+	int ret;
 
         /* we skip the root node of the tree */
 	if (!t->parent)
@@ -130,10 +142,16 @@ static int regulator_display_cb(struct tree *t, void *data)
 	if (!strlen(reg->name))
 		return 0;
 
-	if (asprintf(&buf, "%-11s %-11s %-11s %-11s %-11d %-11d %-11d %-12d",
-		     reg->name, reg->status, reg->state, reg->type,
-		     reg->num_users, reg->microvolts, reg->min_microvolts,
-		     reg->max_microvolts) < 0)
+	if (asprintf(&name, "%*s%s", (t->depth - 1) * 2, "", reg->name) < 0)
+		return -1;
+
+	ret = asprintf(&buf, "%-23s %-11s %-11s %-11s %-11d %-11d %-11d %-11d "
+		       "%-11d %-11lld %-12lld", name, reg->status, reg->state,
+		       reg->type, reg->num_users, reg->total_users,
+		       reg->microvolts, reg->min_microvolts, reg->max_microvolts,
+		       reg->power, reg->total_power);
+	free(name);
+	if (ret < 0)
 		return -1;
 
 	display_print_line(REGULATOR, *line, buf, reg->num_users, t);
@@ -150,9 +168,10 @@ static int regulator_print_header(void)
 	char *buf;
 	int ret;
 
-	if (asprintf(&buf, "%-11s %-11s %-11s %-11s %-11s %-11s %-11s %-12s",
-		     "Name", "Status", "State", "Type", "Users", "Microvolts",
-		     "Min u-volts", "Max u-volts") < 0)
+	if (asprintf(&buf, "%-23s %-11s %-11s %-11s %-11s %-11s %-11s %-11s "
+		     "%-11s %-11s %-12s", "Name", "Status", "State", "Type",
+		     "Users", "Total users", "Microvolts", "Min u-volts",
+		     "Max u-volts", "Power uW", "Total uW") < 0)
 		return -1;
 
 	ret = display_column_name(buf);
@@ -163,27 +182,109 @@ static int regulator_print_header(void)
 
 }
 
-static int regulator_filter_cb(const char *name)
+/* the supply links are read to build the supply graph, not followed */
+static const char * const regulator_shape[] = { "regulator.*", NULL };
+
+/*
+ * A regulator supplying another one has a link to it, named after the
+ * consumer with a "-SUPPLY" suffix. Move the supplied regulators below
+ * their supply.
+ *
+ * @supply : the node of the regulator whose links are read
+ * Returns 0 on success, -1 otherwise
+ */
+static int regulator_read_supplies(struct tree *supply)
 {
-	/* let's ignore some directories in order to avoid to be
-	 * pulled inside the sysfs circular symlinks mess/hell
-	 * (choose the word which fit better)
-	 */
-	if (!strcmp(name, "device"))
-		return 1;
+	DIR *dir;
+	struct dirent *direntp;
+	struct tree *t;
+	char *path, link[PATH_MAX], *name;
+	size_t len, suffix = strlen("-SUPPLY");
+	ssize_t ret;
+
+	dir = opendir(supply->path);
+	if (!dir)
+		return -1;
 
-	if (!strcmp(name, "subsystem"))
-		return 1;
+	while ((direntp = readdir(dir))) {
+
+		len = strlen(direntp->d_name);
+		if (len <= suffix ||
+		    strcmp(direntp->d_name + len - suffix, "-SUPPLY"))
+			continue;
+
+		if (asprintf(&path, "%s/%s", supply->path,
+			     direntp->d_name) < 0)
+			break;
+
+		ret = readlink(path, link, sizeof(link) - 1);
+		free(path);
+		if (ret < 0)
+			continue;
+		link[ret] = '\0';
+
+		name = strrchr(link, '/');
+		name = name ? name + 1 : link;
+
+		/* a supply loop is ignored, tree_move refuses it */
+		t = tree_find(reg_tree, name);
+		if (t && t != supply)
+			tree_move(t, supply);
+	}
 
-	if (!strcmp(name, "driver"))
-		return 1;
+	closedir(dir);
 
 	return 0;
 }
 
+/*
+ * The regulators are loaded as a flat list, build the supply graph
+ * from the links of each regulator and index the resulting tree.
+ */
+static int regulator_supply_graph(void)
+{
+	struct tree **regulators, *t;
+	int i, nr = reg_tree->nrchild;
+
+	regulators = malloc(sizeof(*regulators) * nr);
+	if (!regulators)
+		return -1;
+
+	for (i = 0, t = reg_tree->child; t && i < nr; t = t->next)
+		regulators[i++] = t;
+
+	for (i = 0; i < nr; i++)
+		regulator_read_supplies(regulators[i]);
+
+	free(regulators);
+
+	return tree_index(reg_tree);
+}
+
+/*
+ * Add the difference of users and power of a regulator to its totals
+ * and to the ones of its supplies, only the supply path of a regulator
+ * whose readings changed is updated.
+ */
+static void regulator_propagate(struct tree *t, int users, long long power)
+{
+	struct regulator_info *reg;
+
+	if (!users && !power)
+		return;
+
+	for (; t; t = t->parent) {
+		reg = t->private;
+		reg->total_users += users;
+		reg->total_power += power;
+	}
+}
+
 static inline int read_regulator_cb(struct tree *t, void *data)
 {
 	struct regulator_info *reg = t->private;
+	int num_users = reg->num_users;
+	long long power = reg->power;
 
 	file_read_value(t->path, "name", "%s", reg->name);
 	file_read_value(t->path, "state", "%s", reg->state);
@@ -198,6 +299,10 @@ static inline int read_regulator_cb(struct tree *t, void *data)
 	file_read_value(t->path, "min_microamps", "%d", &reg->min_microamps);
 	file_read_value(t->path, "max_microamps", "%d", &reg->max_microamps);
 
+	reg->power = (long long)reg->microvolts * reg->microamps / 1000000;
+
+	regulator_propagate(t, reg->num_users - num_users, reg->power - power);
+
 	return 0;
 }
 
@@ -206,6 +311,17 @@ static int read_regulator_info(struct tree *tree)
 	return tree_for_each(tree, read_regulator_cb, NULL);
 }
 
+static bool regulator_is_collapsed(struct tree *t)
+{
+	struct regulator_info *reg = t->private;
+
+	return t->parent && !reg->expanded;
+}
+
+/*
+ * Show the supply graph, the regulators supplied by a collapsed one
+ * are skipped.
+ */
 static int regulator_print_info(struct tree *tree)
 {
 	int ret, line = 0;
@@ -214,7 +330,8 @@ static int regulator_print_info(struct tree *tree)
 
 	regulator_print_header();
 
-	ret = tree_for_each(tree, regulator_display_cb, &line);
+	ret = tree_for_each_visible(tree, regulator_is_collapsed,
+				    regulator_display_cb, &line);
 
 	display_refresh_pad(REGULATOR);
 
@@ -245,6 +362,7 @@ static int fill_regulator_cb(struct tree *t, void *data)
 		return -1;
 	}
 	t->private = reg;
+	reg->expanded = true;
 
         /* we skip the root node but we set it expanded for its children */
 	if (!t->parent)
@@ -258,8 +376,51 @@ static int fill_regulator_tree(void)
 	return tree_for_each(reg_tree, fill_regulator_cb, NULL);
 }
 
+static int regulator_snapshot_cb(struct tree *t, void *data)
+{
+	struct snapshot *snap = data;
+	struct regulator_info *reg = t->private;
+
+	if (!t->parent || !strlen(reg->name))
+		return 0;
+
+	if (snapshot_node(snap, t->path) ||
+	    snapshot_string(snap, "name", reg->name) ||
+	    snapshot_string(snap, "state", reg->state) ||
+	    snapshot_string(snap, "status", reg->status) ||
+	    snapshot_string(snap, "type", reg->type) ||
+	    snapshot_string(snap, "opmode", reg->opmode) ||
+	    snapshot_int(snap, "num_users", reg->num_users) ||
+	    snapshot_int(snap, "microvolts", reg->microvolts) ||
+	    snapshot_int(snap, "min_microvolts", reg->min_microvolts) ||
+	    snapshot_int(snap, "max_microvolts", reg->max_microvolts) ||
+	    snapshot_int(snap, "microamps", reg->microamps))
+		return -1;
+
+	return 0;
+}
+
+int regulator_snapshot(struct snapshot *snap)
+{
+	if (read_regulator_info(reg_tree))
+		return -1;
+
+	return tree_for_each(reg_tree, regulator_snapshot_cb, snap);
+}
+
+static int regulator_select(void)
+{
+	struct tree *t = display_get_row_data(REGULATOR);
+	struct regulator_info *reg = t->private;
+
+	reg->expanded = !reg->expanded;
+
+	return 0;
+}
+
 static struct display_ops regulator_ops = {
 	.display = regulator_display,
+	.select  = regulator_select,
 };
 
 int regulator_init(void)
@@ -273,10 +434,13 @@ int regulator_init(void)
 	if (access(SYSFS_REGULATOR, F_OK))
 		regulator_error = true; /* set the flag */
 
-	reg_tree = tree_load(SYSFS_REGULATOR, regulator_filter_cb, false);
+	reg_tree = tree_load_shape(SYSFS_REGULATOR, regulator_shape, true);
 	if (!reg_tree)
 		return -1;
 
+	if (regulator_supply_graph())
+		return -1;
+
 	if (fill_regulator_tree())
 		return -1;
 
@@ -13,5 +13,8 @@
  *       - initial API and implementation
  *******************************************************************************/
 
+struct snapshot;
+
 extern int regulator_init(void);
 extern int regulator_dump(void);
+extern int regulator_snapshot(struct snapshot *snap);
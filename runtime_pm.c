@@ -0,0 +1,589 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * The runtime power management of the devices. The devices having a
+ * power/runtime_status attribute are found once by scanning /sys/devices
+ * with several threads sharing a queue of directories. The symbolic
+ * links are not followed, so the scan can't loop. Then only the power
+ * attributes are read through held file descriptors, and the devices are
+ * ranked by their active time in the last interval, the devices which
+ * don't suspend showing first.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#undef _GNU_SOURCE
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "powerdebug.h"
+#include "display.h"
+#include "runtime_pm.h"
+#include "snapshot.h"
+#include "utils.h"
+
+#define SYSFS_DEVICES "/sys/devices"
+
+#define RPM_STATUS_MAX 16
+#define RPM_SCAN_THREADS 8
+#define RPM_SCAN_DEPTH 32
+
+/* the share of the open files limit the devices can keep opened */
+#define RPM_NOFILE_SHARE 2
+
+/*
+ * A device with runtime power management
+ *
+ * path      : the directory of the device
+ * fd_status : power/runtime_status
+ * fd_active : power/runtime_active_time, in ms
+ * fd_suspended : power/runtime_suspended_time, in ms
+ * dactive   : the active time of the last interval
+ *
+ * The files are read by path when they could not be kept opened.
+ */
+struct rpm_device {
+	char *path;
+	char status[RPM_STATUS_MAX];
+	int fd_status;
+	int fd_active;
+	int fd_suspended;
+	long long active;
+	long long suspended;
+	long long dactive;
+	long long dsuspended;
+};
+
+/*
+ * The state shared by the scanning threads: a queue of directories to
+ * be read, the number of threads reading one and the devices found
+ */
+struct rpm_scan {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	char **queue;
+	int *depths;
+	int nrqueue;
+	int maxqueue;
+	int busy;
+	bool failed;
+};
+
+static struct rpm_device *rpm_devices;
+static int rpm_nrdevices;
+static int rpm_maxdevices;
+
+/* the devices sorted by active time in the last interval */
+static struct rpm_device **rpm_ranked;
+
+static uint64_t rpm_sampled;
+static uint64_t rpm_interval;
+static bool rpm_error = false;
+
+static int rpm_queue_push(struct rpm_scan *scan, char *path, int depth)
+{
+	char **queue;
+	int *depths, max;
+
+	if (scan->nrqueue == scan->maxqueue) {
+
+		max = scan->maxqueue ? scan->maxqueue * 2 : 1024;
+
+		queue = realloc(scan->queue, max * sizeof(*queue));
+		if (!queue)
+			return -1;
+		scan->queue = queue;
+
+		depths = realloc(scan->depths, max * sizeof(*depths));
+		if (!depths)
+			return -1;
+		scan->depths = depths;
+
+		scan->maxqueue = max;
+	}
+
+	scan->queue[scan->nrqueue] = path;
+	scan->depths[scan->nrqueue] = depth;
+	scan->nrqueue++;
+
+	return 0;
+}
+
+static int rpm_add_device(const char *path)
+{
+	struct rpm_device *devices;
+	int max;
+
+	if (rpm_nrdevices == rpm_maxdevices) {
+
+		max = rpm_maxdevices ? rpm_maxdevices * 2 : 1024;
+
+		devices = realloc(rpm_devices, max * sizeof(*devices));
+		if (!devices)
+			return -1;
+
+		rpm_devices = devices;
+		rpm_maxdevices = max;
+	}
+
+	memset(&rpm_devices[rpm_nrdevices], 0, sizeof(*rpm_devices));
+
+	rpm_devices[rpm_nrdevices].path = strdup(path);
+	if (!rpm_devices[rpm_nrdevices].path)
+		return -1;
+
+	rpm_nrdevices++;
+
+	return 0;
+}
+
+static bool rpm_is_dir(int dirfd, struct dirent *dirent)
+{
+	struct stat s;
+
+	if (dirent->d_type != DT_UNKNOWN)
+		return dirent->d_type == DT_DIR;
+
+	/* the links are not followed */
+	if (fstatat(dirfd, dirent->d_name, &s, AT_SYMLINK_NOFOLLOW))
+		return false;
+
+	return S_ISDIR(s.st_mode);
+}
+
+/*
+ * Read a directory, queue its subdirectories and record it as a device
+ * if it has the runtime power management attributes. The queue lock is
+ * taken once for all the entries of the directory.
+ */
+static int rpm_scan_dir(struct rpm_scan *scan, const char *path, int depth)
+{
+	struct dirent *dirent;
+	char **subdirs = NULL, **tmp;
+	int nrsubdirs = 0, i, ret = 0;
+	bool device = false;
+	DIR *dir;
+
+	dir = opendir(path);
+	if (!dir)
+		return 0;
+
+	while ((dirent = readdir(dir))) {
+
+		if (!strcmp(dirent->d_name, ".") ||
+		    !strcmp(dirent->d_name, ".."))
+			continue;
+
+		if (!rpm_is_dir(dirfd(dir), dirent))
+			continue;
+
+		/* the attributes, unless it is a device named power */
+		if (!strcmp(dirent->d_name, "power") &&
+		    !faccessat(dirfd(dir), "power/runtime_status", R_OK, 0)) {
+			device = true;
+			continue;
+		}
+
+		if (depth + 1 >= RPM_SCAN_DEPTH)
+			continue;
+
+		tmp = realloc(subdirs, (nrsubdirs + 1) * sizeof(*subdirs));
+		if (!tmp) {
+			ret = -1;
+			break;
+		}
+		subdirs = tmp;
+
+		if (asprintf(&subdirs[nrsubdirs], "%s/%s", path,
+			     dirent->d_name) < 0) {
+			ret = -1;
+			break;
+		}
+		nrsubdirs++;
+	}
+
+	closedir(dir);
+
+	pthread_mutex_lock(&scan->lock);
+
+	for (i = 0; i < nrsubdirs; i++) {
+		if (!ret && rpm_queue_push(scan, subdirs[i], depth + 1))
+			ret = -1;
+		if (ret)
+			free(subdirs[i]);
+	}
+
+	if (!ret && device)
+		ret = rpm_add_device(path);
+
+	pthread_mutex_unlock(&scan->lock);
+
+	free(subdirs);
+
+	return ret;
+}
+
+static void *rpm_scan_thread(void *data)
+{
+	struct rpm_scan *scan = data;
+	char *path;
+	int depth, ret;
+
+	pthread_mutex_lock(&scan->lock);
+
+	for (;;) {
+
+		while (!scan->nrqueue && scan->busy && !scan->failed)
+			pthread_cond_wait(&scan->cond, &scan->lock);
+
+		/* nothing to read and nobody to queue more */
+		if (!scan->nrqueue || scan->failed)
+			break;
+
+		scan->nrqueue--;
+		path = scan->queue[scan->nrqueue];
+		depth = scan->depths[scan->nrqueue];
+		scan->busy++;
+
+		pthread_mutex_unlock(&scan->lock);
+
+		ret = rpm_scan_dir(scan, path, depth);
+		free(path);
+
+		pthread_mutex_lock(&scan->lock);
+
+		scan->busy--;
+		if (ret)
+			scan->failed = true;
+
+		pthread_cond_broadcast(&scan->cond);
+	}
+
+	pthread_cond_broadcast(&scan->cond);
+	pthread_mutex_unlock(&scan->lock);
+
+	return NULL;
+}
+
+/*
+ * Find the devices under a directory with a thread per cpu, up to
+ * RPM_SCAN_THREADS, the calling thread taking its share.
+ * Returns 0 on success, -1 otherwise
+ */
+static int rpm_scan(const char *path)
+{
+	struct rpm_scan scan = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+	};
+	pthread_t threads[RPM_SCAN_THREADS];
+	long nrcpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int i, nrthreads = 0;
+	char *root;
+
+	root = strdup(path);
+	if (!root || rpm_queue_push(&scan, root, 0)) {
+		free(root);
+		return -1;
+	}
+
+	for (i = 1; i < nrcpus && i < RPM_SCAN_THREADS; i++) {
+		if (pthread_create(&threads[nrthreads], NULL,
+				   rpm_scan_thread, &scan))
+			break;
+		nrthreads++;
+	}
+
+	rpm_scan_thread(&scan);
+
+	for (i = 0; i < nrthreads; i++)
+		pthread_join(threads[i], NULL);
+
+	for (i = 0; i < scan.nrqueue; i++)
+		free(scan.queue[i]);
+	free(scan.queue);
+	free(scan.depths);
+
+	return scan.failed ? -1 : 0;
+}
+
+static void fd_read_string(int fd, char *buf, size_t size)
+{
+	ssize_t len;
+
+	len = pread(fd, buf, size - 1, 0);
+	if (len <= 0)
+		return;
+
+	buf[len] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+}
+
+static int rpm_compare(const void *a, const void *b)
+{
+	const struct rpm_device *deva = *(struct rpm_device * const *)a;
+	const struct rpm_device *devb = *(struct rpm_device * const *)b;
+
+	if (deva->dactive != devb->dactive)
+		return deva->dactive < devb->dactive ? 1 : -1;
+
+	if (deva->active != devb->active)
+		return deva->active < devb->active ? 1 : -1;
+
+	return strcmp(deva->path, devb->path);
+}
+
+static int read_rpm_info(void)
+{
+	uint64_t now = time_monotonic_us();
+	struct rpm_device *dev;
+	long long active, suspended;
+	int i;
+
+	for (i = 0; i < rpm_nrdevices; i++) {
+
+		dev = &rpm_devices[i];
+
+		if (dev->fd_status >= 0)
+			fd_read_string(dev->fd_status, dev->status,
+				       sizeof(dev->status));
+		else
+			file_read_value(dev->path, "power/runtime_status",
+					"%15s", dev->status);
+
+		if (dev->fd_active >= 0 ?
+		    fd_read_value(dev->fd_active, &active) :
+		    file_read_value(dev->path, "power/runtime_active_time",
+				    "%lld", &active))
+			active = dev->active;
+
+		if (dev->fd_suspended >= 0 ?
+		    fd_read_value(dev->fd_suspended, &suspended) :
+		    file_read_value(dev->path, "power/runtime_suspended_time",
+				    "%lld", &suspended))
+			suspended = dev->suspended;
+
+		dev->dactive = rpm_sampled ? active - dev->active : 0;
+		dev->dsuspended = rpm_sampled ? suspended - dev->suspended : 0;
+		dev->active = active;
+		dev->suspended = suspended;
+	}
+
+	rpm_interval = rpm_sampled ? now - rpm_sampled : 0;
+	rpm_sampled = now;
+
+	qsort(rpm_ranked, rpm_nrdevices, sizeof(*rpm_ranked), rpm_compare);
+
+	return 0;
+}
+
+static inline double rpm_percent(long long value, long long total)
+{
+	return total ? (double)value * 100 / total : 0;
+}
+
+/* the devices are showed with their path below /sys/devices */
+static const char *rpm_name(struct rpm_device *dev)
+{
+	return dev->path + strlen(SYSFS_DEVICES "/");
+}
+
+static int rpm_print_header(void)
+{
+	char *buf;
+	int ret;
+
+	if (asprintf(&buf, "%-60s %-12s %-10s %-14s %-14s", "Device",
+		     "Status", "Active %", "Active s", "Suspended s") < 0)
+		return -1;
+
+	ret = display_column_name(buf);
+
+	free(buf);
+
+	return ret;
+}
+
+static int rpm_print_info(void)
+{
+	struct rpm_device *dev;
+	const char *name;
+	char *buf;
+	int i, ret = 0;
+
+	display_reset_cursor(RUNTIME_PM);
+
+	rpm_print_header();
+
+	for (i = 0; i < rpm_nrdevices; i++) {
+
+		dev = rpm_ranked[i];
+
+		/* the end of the path, the beginning is the least useful */
+		name = rpm_name(dev);
+		if (strlen(name) > 60)
+			name += strlen(name) - 60;
+
+		if (asprintf(&buf, "%-60s %-12s %-10.1f %-14.1f %-14.1f", name,
+			     dev->status,
+			     rpm_percent(dev->dactive * 1000, rpm_interval),
+			     (double)dev->active / 1000,
+			     (double)dev->suspended / 1000) < 0) {
+			ret = -1;
+			break;
+		}
+
+		display_print_line(RUNTIME_PM, i, buf, dev->dactive > 0, NULL);
+		free(buf);
+	}
+
+	display_refresh_pad(RUNTIME_PM);
+
+	return ret;
+}
+
+static int runtime_pm_display(bool refresh)
+{
+	if (rpm_error || !rpm_nrdevices) {
+		display_message(RUNTIME_PM,
+			"error: no runtime pm device found in " SYSFS_DEVICES);
+		return -2;
+	}
+
+	if (refresh && read_rpm_info())
+		return -1;
+
+	return rpm_print_info();
+}
+
+int runtime_pm_dump(void)
+{
+	struct rpm_device *dev;
+	int i;
+
+	printf("\nRuntime PM Information:\n");
+	printf("***********************\n");
+
+	if (read_rpm_info())
+		return -1;
+
+	for (i = 0; i < rpm_nrdevices; i++) {
+		dev = rpm_ranked[i];
+		printf("%s: %s, active %lld ms, suspended %lld ms\n",
+		       rpm_name(dev), dev->status, dev->active,
+		       dev->suspended);
+	}
+
+	return 0;
+}
+
+int runtime_pm_snapshot(struct snapshot *snap)
+{
+	struct rpm_device *dev;
+	int i;
+
+	if (read_rpm_info())
+		return -1;
+
+	for (i = 0; i < rpm_nrdevices; i++) {
+		dev = &rpm_devices[i];
+		if (snapshot_node(snap, dev->path) ||
+		    snapshot_string(snap, "runtime_status", dev->status))
+			return -1;
+	}
+
+	return 0;
+}
+
+static int rpm_open_devices(void)
+{
+	struct rpm_device *dev;
+	char *power;
+	long nofile;
+	int i, maxopened;
+
+	rpm_ranked = malloc(rpm_nrdevices * sizeof(*rpm_ranked));
+	if (!rpm_ranked)
+		return -1;
+
+	/*
+	 * Three files per device are kept opened, within a share of the
+	 * limit so the other subsystems can still open theirs
+	 */
+	nofile = file_raise_nofile();
+	maxopened = nofile < 0 ? 0 :
+		nofile / RPM_NOFILE_SHARE / 3 < rpm_nrdevices ?
+		nofile / RPM_NOFILE_SHARE / 3 : rpm_nrdevices;
+
+	for (i = 0; i < rpm_nrdevices; i++) {
+
+		dev = &rpm_devices[i];
+		rpm_ranked[i] = dev;
+
+		if (i >= maxopened) {
+			dev->fd_status = -1;
+			dev->fd_active = -1;
+			dev->fd_suspended = -1;
+			continue;
+		}
+
+		if (asprintf(&power, "%s/power", dev->path) < 0)
+			return -1;
+
+		dev->fd_status = file_open_value(power, "runtime_status");
+		dev->fd_active = file_open_value(power, "runtime_active_time");
+		dev->fd_suspended = file_open_value(power,
+						"runtime_suspended_time");
+		free(power);
+	}
+
+	return 0;
+}
+
+static struct display_ops runtime_pm_ops = {
+	.display = runtime_pm_display,
+};
+
+int runtime_pm_init(void)
+{
+	int ret;
+
+	ret = display_register(RUNTIME_PM, &runtime_pm_ops);
+	if (ret)
+		printf("error: runtime pm display register failed");
+
+	if (access(SYSFS_DEVICES, F_OK)) {
+		rpm_error = true; /* set the flag */
+		return -1;
+	}
+
+	if (rpm_scan(SYSFS_DEVICES))
+		return -1;
+
+	if (!rpm_nrdevices)
+		return -1;
+
+	if (rpm_open_devices())
+		return -1;
+
+	if (read_rpm_info())
+		return -1;
+
+	return ret;
+}
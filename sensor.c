@@ -27,34 +27,106 @@
 #include "display.h"
 #include "sensor.h"
 #include "tree.h"
+#include "snapshot.h"
 #include "utils.h"
+#include "energy.h"
 
 #define SYSFS_SENSOR "/sys/class/hwmon"
 
 static struct tree *sensor_tree;
 static bool sensor_error = false;
 
-struct temp_info {
-	char name[NAME_MAX];
-	int temp;
+/*
+ * The hwmon channel types, the attributes of a channel are named
+ * <prefix><index>_<attribute> and the values are integers in a fraction
+ * of the unit given by the scale.
+ */
+enum sensor_type {
+	SENSOR_TEMP,
+	SENSOR_IN,
+	SENSOR_CURR,
+	SENSOR_POWER,
+	SENSOR_ENERGY,
+	SENSOR_FAN,
+	SENSOR_HUMIDITY,
+	SENSOR_TYPE_MAX,
 };
 
-struct fan_info {
-	char name[NAME_MAX];
-	int rpms;
+static const struct {
+	const char *prefix;
+	const char *unit;
+	int scale;
+	int decimals;
+} sensor_types[] = {
+	[SENSOR_TEMP]     = { "temp",     "C",   1000,    1 },
+	[SENSOR_IN]       = { "in",       "V",   1000,    3 },
+	[SENSOR_CURR]     = { "curr",     "A",   1000,    3 },
+	[SENSOR_POWER]    = { "power",    "W",   1000000, 3 },
+	[SENSOR_ENERGY]   = { "energy",   "J",   1000000, 3 },
+	[SENSOR_FAN]      = { "fan",      "rpm", 1,       0 },
+	[SENSOR_HUMIDITY] = { "humidity", "%",   1000,    1 },
+};
+
+/* The attributes of a channel read once, when the channel is found */
+enum sensor_limit {
+	SENSOR_MIN,
+	SENSOR_MAX,
+	SENSOR_CRIT,
+	SENSOR_LIMIT_MAX,
+};
+
+static const char *sensor_limits[] = {
+	[SENSOR_MIN]  = "min",
+	[SENSOR_MAX]  = "max",
+	[SENSOR_CRIT] = "crit",
+};
+
+/*
+ * A channel of a hwmon device
+ *
+ * name   : the attribute prefix, eg. temp1
+ * label  : the content of the _label attribute or the name
+ * fd     : the _input attribute, kept opened, or _average for the
+ *          power channels without _input
+ * value  : the last value read
+ * limits : the _min, _max and _crit attributes
+ * valid  : a bitmask of the limits present
+ * energy : for the energy channels, the power derived from the counter
+ */
+struct sensor_channel {
+	enum sensor_type type;
+	int index;
+	char name[32];
+	char label[NAME_MAX];
+	int fd;
+	long long value;
+	long long limits[SENSOR_LIMIT_MAX];
+	int valid;
+	struct energy *energy;
 };
 
 struct sensor_info {
 	char name[NAME_MAX];
-	struct temp_info *temperatures;
-	struct fan_info *fans;
-	short nrtemps;
-	short nrfans;
+	struct sensor_channel *channels;
+	int nrchannels;
 };
 
+static char *sensor_value(struct sensor_channel *chan, long long value)
+{
+	char *buf;
+
+	if (asprintf(&buf, "%.*f %s", sensor_types[chan->type].decimals,
+		     (double)value / sensor_types[chan->type].scale,
+		     sensor_types[chan->type].unit) < 0)
+		return NULL;
+
+	return buf;
+}
+
 static int sensor_dump_cb(struct tree *tree, void *data)
 {
 	int i;
+	char *value;
 	struct sensor_info *sensor = tree->private;
 
 	if (!strlen(sensor->name))
@@ -62,13 +134,17 @@ static int sensor_dump_cb(struct tree *tree, void *data)
 
 	printf("%s\n", sensor->name);
 
-	for (i = 0; i < sensor->nrtemps; i++)
-		printf(" %s %.1f °C/V\n", sensor->temperatures[i].name,
-		       (float)sensor->temperatures[i].temp / 1000);
+	for (i = 0; i < sensor->nrchannels; i++) {
+
+		value = sensor_value(&sensor->channels[i],
+				     sensor->channels[i].value);
+		if (!value)
+			return -1;
 
-	for (i = 0; i < sensor->nrfans; i++)
-		printf(" %s %d rpm\n", sensor->fans[i].name,
-		       sensor->fans[i].rpms);
+		printf(" %s %s\n", sensor->channels[i].label, value);
+
+		free(value);
+	}
 
 	return 0;
 }
@@ -92,15 +168,99 @@ static struct sensor_info *sensor_alloc(void)
 	return sensor;
 }
 
-static int read_sensor_cb(struct tree *tree, void *data)
+/*
+ * Split an attribute name in a channel type, an index and an attribute.
+ *
+ * @name : the file name, eg. temp1_input
+ * @type : filled with the channel type
+ * @attr : filled with a pointer to the attribute in the name
+ * Returns the channel index on success, -1 if it is not a channel
+ */
+static int sensor_parse(const char *name, enum sensor_type *type,
+			const char **attr)
+{
+	size_t len;
+	char *end;
+	int i, index;
+
+	for (i = 0; i < SENSOR_TYPE_MAX; i++) {
+
+		len = strlen(sensor_types[i].prefix);
+		if (strncmp(name, sensor_types[i].prefix, len))
+			continue;
+
+		if (name[len] < '0' || name[len] > '9')
+			continue;
+
+		index = strtol(name + len, &end, 10);
+		if (*end != '_')
+			continue;
+
+		*type = i;
+		*attr = end + 1;
+
+		return index;
+	}
+
+	return -1;
+}
+
+static struct sensor_channel *sensor_channel(struct sensor_info *sensor,
+					     enum sensor_type type, int index,
+					     int *size)
+{
+	struct sensor_channel *chan;
+	int i;
+
+	for (i = 0; i < sensor->nrchannels; i++) {
+		chan = &sensor->channels[i];
+		if (chan->type == type && chan->index == index)
+			return chan;
+	}
+
+	if (sensor->nrchannels == *size) {
+		*size = *size ? *size * 2 : 8;
+		chan = realloc(sensor->channels, sizeof(*chan) * *size);
+		if (!chan)
+			return NULL;
+		sensor->channels = chan;
+	}
+
+	chan = &sensor->channels[sensor->nrchannels++];
+	memset(chan, 0, sizeof(*chan));
+	chan->type = type;
+	chan->index = index;
+	chan->fd = -1;
+	snprintf(chan->name, sizeof(chan->name), "%s%d",
+		 sensor_types[type].prefix, index);
+
+	return chan;
+}
+
+static int sensor_channel_cmp(const void *a, const void *b)
+{
+	const struct sensor_channel *c1 = a, *c2 = b;
+
+	if (c1->type != c2->type)
+		return c1->type - c2->type;
+
+	return c1->index - c2->index;
+}
+
+/*
+ * Build the catalog of the channels of a hwmon directory, the limits
+ * and the labels are read once and the _input attributes are kept
+ * opened for the refreshes.
+ */
+static int sensor_discover(struct tree *tree)
 {
 	DIR *dir;
-	int value;
-        struct dirent dirent, *direntp;
+	struct dirent *direntp;
 	struct sensor_info *sensor = tree->private;
-
-	int nrtemps = 0;
-	int nrfans = 0;
+	struct sensor_channel *chan;
+	enum sensor_type type;
+	const char *attr;
+	int i, index, size = 0;
 
 	dir = opendir(tree->path);
 	if (!dir)
@@ -108,57 +268,96 @@ static int read_sensor_cb(struct tree *tree, void *data)
 
 	file_read_value(tree->path, "name", "%s", sensor->name);
 
-	while (!readdir_r(dir, &dirent, &direntp)) {
-
-                if (!direntp)
-                        break;
+	while ((direntp = readdir(dir))) {
 
 		if (direntp->d_type != DT_REG)
 			continue;
 
-		if (!strncmp(direntp->d_name, "temp", 4)) {
+		index = sensor_parse(direntp->d_name, &type, &attr);
+		if (index < 0)
+			continue;
 
-			if (file_read_value(tree->path, direntp->d_name, "%d",
-					    &value))
-				continue;
+		chan = sensor_channel(sensor, type, index, &size);
+		if (!chan)
+			break;
 
-			sensor->temperatures =
-				realloc(sensor->temperatures,
-					sizeof(struct temp_info) * (nrtemps + 1));
-			if (!sensor->temperatures)
-				continue;
-
-			strcpy(sensor->temperatures[nrtemps].name,
-			       direntp->d_name);
-			sensor->temperatures[nrtemps].temp = value;
+		if (!strcmp(attr, "input")) {
+			if (chan->fd >= 0)
+				close(chan->fd);
+			chan->fd = file_open_value(tree->path,
+						   direntp->d_name);
+			continue;
+		}
 
-			nrtemps++;
+		if (!strcmp(attr, "average") && type == SENSOR_POWER) {
+			if (chan->fd < 0)
+				chan->fd = file_open_value(tree->path,
+							   direntp->d_name);
+			continue;
 		}
 
-		if (!strncmp(direntp->d_name, "fan", 3)) {
+		if (!strcmp(attr, "label")) {
+			file_read_value(tree->path, direntp->d_name,
+					"%254[^\n]", chan->label);
+			continue;
+		}
 
-			if (file_read_value(tree->path, direntp->d_name, "%d",
-					    &value))
+		for (i = 0; i < SENSOR_LIMIT_MAX; i++) {
+			if (strcmp(attr, sensor_limits[i]))
 				continue;
+			if (!file_read_value(tree->path, direntp->d_name,
+					     "%lld", &chan->limits[i]))
+				chan->valid |= 1 << i;
+		}
+	}
 
-			sensor->fans =
-				realloc(sensor->fans,
-					sizeof(struct temp_info) * (nrfans + 1));
-			if (!sensor->fans)
-				continue;
+	closedir(dir);
+
+	/* the channels without value are not showed */
+	for (i = 0; i < sensor->nrchannels; ) {
+
+		chan = &sensor->channels[i];
+
+		if (chan->fd < 0) {
+			*chan = sensor->channels[--sensor->nrchannels];
+			continue;
+		}
 
-			strcpy(sensor->fans[nrfans].name,
-			       direntp->d_name);
-			sensor->fans[nrfans].rpms = value;
+		if (!strlen(chan->label))
+			strcpy(chan->label, chan->name);
 
-			nrfans++;
+		if (chan->type == SENSOR_ENERGY) {
+			chan->energy = malloc(sizeof(*chan->energy));
+			if (!chan->energy)
+				return -1;
+			energy_init(chan->energy, 0);
 		}
+		i++;
 	}
 
-	sensor->nrtemps = nrtemps;
-	sensor->nrfans = nrfans;
+	qsort(sensor->channels, sensor->nrchannels, sizeof(*chan),
+	      sensor_channel_cmp);
 
-	closedir(dir);
+	return 0;
+}
+
+static int read_sensor_cb(struct tree *tree, void *data)
+{
+	struct sensor_info *sensor = tree->private;
+	struct sensor_channel *chan;
+	uint64_t now = time_monotonic_us();
+	int i;
+
+	for (i = 0; i < sensor->nrchannels; i++) {
+
+		chan = &sensor->channels[i];
+
+		if (fd_read_value(chan->fd, &chan->value))
+			continue;
+
+		if (chan->energy)
+			energy_sample(chan->energy, chan->value, now);
+	}
 
 	return 0;
 }
@@ -181,6 +380,9 @@ static int fill_sensor_cb(struct tree *t, void *data)
 	if (!t->parent)
 		return 0;
 
+	if (sensor_discover(t))
+		return -1;
+
 	return read_sensor_cb(t, data);
 }
 
@@ -189,33 +391,16 @@ static int fill_sensor_tree(void)
 	return tree_for_each(sensor_tree, fill_sensor_cb, NULL);
 }
 
-static int sensor_filter_cb(const char *name)
-{
-	/* let's ignore some directories in order to avoid to be
-	 * pulled inside the sysfs circular symlinks mess/hell
-	 * (choose the word which fit better)
-	 */
-	if (!strcmp(name, "subsystem"))
-		return 1;
-
-	if (!strcmp(name, "driver"))
-		return 1;
-
-	if (!strcmp(name, "hwmon"))
-		return 1;
-
-	if (!strcmp(name, "power"))
-		return 1;
-
-	return 0;
-}
+/* the old drivers have their attributes in the device directory */
+static const char * const sensor_shape[] = { "hwmon*", "device", NULL };
 
 static int sensor_display_cb(struct tree *t, void *data)
 {
 	struct sensor_info *sensor = t->private;
+	struct sensor_channel *chan;
 	int *line = data;
-	char buf[1024];
-	int i;
+	char buf[1024], power[32], *values[SENSOR_LIMIT_MAX + 1];
+	int i, j, ret = -1;
 
 	if (!strlen(sensor->name))
 		return 0;
@@ -225,21 +410,48 @@ static int sensor_display_cb(struct tree *t, void *data)
 
 	(*line)++;
 
-	for (i = 0; i < sensor->nrtemps; i++) {
-		sprintf(buf, " %-35s%.1f", sensor->temperatures[i].name,
-		       (float)sensor->temperatures[i].temp / 1000);
-		display_print_line(SENSOR, *line, buf, 0, t);
-		(*line)++;
-	}
+	for (i = 0; i < sensor->nrchannels; i++) {
 
-	for (i = 0; i < sensor->nrfans; i++) {
-		sprintf(buf, " %-35s%d rpm", sensor->fans[i].name,
-			sensor->fans[i].rpms);
+		chan = &sensor->channels[i];
+
+		memset(values, 0, sizeof(values));
+
+		values[0] = sensor_value(chan, chan->value);
+		if (!values[0])
+			goto out;
+
+		for (j = 0; j < SENSOR_LIMIT_MAX; j++) {
+			values[j + 1] = chan->valid & (1 << j) ?
+				sensor_value(chan, chan->limits[j]) :
+				strdup("");
+			if (!values[j + 1])
+				goto out;
+		}
+
+		/* the power derived from the energy counter */
+		if (chan->energy && chan->energy->nrsamples > 1)
+			snprintf(power, sizeof(power), "%.3f W  %.3f W",
+				 energy_power(chan->energy) / 1000000,
+				 energy_power_window(chan->energy,
+						     ENERGY_WINDOW) / 1000000);
+		else
+			power[0] = '\0';
+
+		snprintf(buf, sizeof(buf), " %-35s%-14s%-14s%-14s%-14s%s",
+			 chan->label, values[0], values[1], values[2],
+			 values[3], power);
 		display_print_line(SENSOR, *line, buf, 0, t);
 		(*line)++;
+
+		for (j = 0; j <= SENSOR_LIMIT_MAX; j++)
+			free(values[j]);
 	}
 
 	return 0;
+out:
+	for (j = 0; j <= SENSOR_LIMIT_MAX; j++)
+		free(values[j]);
+	return ret;
 }
 
 static int sensor_print_header(void)
@@ -247,7 +459,8 @@ static int sensor_print_header(void)
 	char *buf;
 	int ret;
 
-	if (asprintf(&buf, "%-36s%s", "Name", "Value") < 0)
+	if (asprintf(&buf, "%-36s%-14s%-14s%-14s%-14s%s", "Name", "Value",
+		     "Min", "Max", "Crit", "Power  Avg power") < 0)
 		return -1;
 
 	ret = display_column_name(buf);
@@ -256,7 +469,6 @@ static int sensor_print_header(void)
 
 	return ret;
 }
-
 static int sensor_print_info(struct tree *tree)
 {
 	int ret, line = 0;
@@ -286,6 +498,35 @@ static int sensor_display(bool refresh)
 	return sensor_print_info(sensor_tree);
 }
 
+static int sensor_snapshot_cb(struct tree *t, void *data)
+{
+	struct snapshot *snap = data;
+	struct sensor_info *sensor = t->private;
+	int i;
+
+	if (!strlen(sensor->name))
+		return 0;
+
+	if (snapshot_node(snap, t->path) ||
+	    snapshot_string(snap, "name", sensor->name))
+		return -1;
+
+	for (i = 0; i < sensor->nrchannels; i++)
+		if (snapshot_int(snap, sensor->channels[i].name,
+				 sensor->channels[i].value))
+			return -1;
+
+	return 0;
+}
+
+int sensor_snapshot(struct snapshot *snap)
+{
+	if (read_sensor_info(sensor_tree))
+		return -1;
+
+	return tree_for_each(sensor_tree, sensor_snapshot_cb, snap);
+}
+
 static struct display_ops sensor_ops = {
 	.display = sensor_display,
 };
@@ -301,7 +542,7 @@ int sensor_init(void)
 	if (access(SYSFS_SENSOR, F_OK))
 		sensor_error = true; /* set the flag */
 
-	sensor_tree = tree_load(SYSFS_SENSOR, sensor_filter_cb, false);
+	sensor_tree = tree_load_shape(SYSFS_SENSOR, sensor_shape, true);
 	if (!sensor_tree)
 		return -1;
 
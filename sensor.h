@@ -13,5 +13,8 @@
  *       - initial API and implementation
  *******************************************************************************/
 
+struct snapshot;
+
 extern int sensor_dump(void);
+extern int sensor_snapshot(struct snapshot *snap);
 extern int sensor_init(void);
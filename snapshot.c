@@ -0,0 +1,603 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * A snapshot is the state of the nodes of the different subsystems at a
+ * given time. A node is identified by its path and has a list of named
+ * attributes, integers or strings.
+ *
+ * The snapshot is written in a compact binary format, in the byte order
+ * of the machine:
+ *
+ *   header
+ *   attribute names, nul terminated strings
+ *   string pool, the paths and the string values, nul terminated
+ *   nodes
+ *   attributes, the attributes of a node are contiguous
+ *
+ * Two snapshots are compared by joining their nodes on the path with a
+ * hash table, so the comparison is linear with the number of nodes.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "hash.h"
+#include "snapshot.h"
+#include "utils.h"
+
+#define SNAPSHOT_MAGIC		"PWRDBGSS"
+#define SNAPSHOT_VERSION	1
+#define SNAPSHOT_BYTEORDER	0x01020304
+
+enum { SNAPSHOT_INT, SNAPSHOT_STRING };
+
+struct snapshot_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder;
+	uint32_t nrnames;
+	uint32_t namesize;
+	uint32_t poolsize;
+	uint32_t nrnodes;
+	uint32_t nrattrs;
+};
+
+struct snapshot_node {
+	uint32_t path;
+	uint32_t attr;
+	uint32_t nrattrs;
+};
+
+/* the value is an offset in the string pool for the string attributes */
+struct snapshot_attr {
+	int64_t value;
+	uint32_t name;
+	uint32_t type;
+};
+
+struct snapshot {
+	struct snapshot_node *nodes;
+	unsigned int nrnodes;
+	unsigned int maxnodes;
+	struct snapshot_attr *attrs;
+	unsigned int nrattrs;
+	unsigned int maxattrs;
+	char *names;
+	size_t namesize;
+	uint32_t *nameoff;
+	unsigned int nrnames;
+	char *pool;
+	size_t poolsize;
+	size_t poolmax;
+};
+
+struct snapshot *snapshot_alloc(void)
+{
+	struct snapshot *snap;
+
+	snap = malloc(sizeof(*snap));
+	if (snap)
+		memset(snap, 0, sizeof(*snap));
+
+	return snap;
+}
+
+void snapshot_free(struct snapshot *snap)
+{
+	if (!snap)
+		return;
+
+	free(snap->nodes);
+	free(snap->attrs);
+	free(snap->names);
+	free(snap->nameoff);
+	free(snap->pool);
+	free(snap);
+}
+
+unsigned int snapshot_nrnodes(struct snapshot *snap)
+{
+	return snap->nrnodes;
+}
+
+/*
+ * Grow an array to contain at least one more element.
+ */
+static int snapshot_grow(void **array, unsigned int nr, unsigned int *max,
+			 size_t size)
+{
+	void *p;
+
+	if (nr < *max)
+		return 0;
+
+	p = realloc(*array, size * (*max ? *max * 2 : 256));
+	if (!p)
+		return -1;
+
+	*array = p;
+	*max = *max ? *max * 2 : 256;
+
+	return 0;
+}
+
+static int64_t snapshot_pool_add(struct snapshot *snap, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	int64_t offset = snap->poolsize;
+	char *p;
+
+	while (snap->poolsize + len > snap->poolmax) {
+		p = realloc(snap->pool, snap->poolmax ? snap->poolmax * 2 : 65536);
+		if (!p)
+			return -1;
+		snap->pool = p;
+		snap->poolmax = snap->poolmax ? snap->poolmax * 2 : 65536;
+	}
+
+	memcpy(snap->pool + offset, str, len);
+	snap->poolsize += len;
+
+	return offset;
+}
+
+static inline const char *snapshot_name(struct snapshot *snap, uint32_t id)
+{
+	return snap->names + snap->nameoff[id];
+}
+
+/*
+ * Returns the index of an attribute name in the dictionary, the name is
+ * added if it is not there. The nodes of a subsystem have usually the
+ * same attributes in the same order, the name used at the same position
+ * in the previous node is checked first.
+ */
+static int snapshot_name_id(struct snapshot *snap, const char *name)
+{
+	struct snapshot_node *node = &snap->nodes[snap->nrnodes - 1];
+	struct snapshot_node *prev;
+	size_t len = strlen(name) + 1;
+	uint32_t *nameoff;
+	unsigned int i;
+	char *names;
+
+	if (snap->nrnodes > 1) {
+		prev = node - 1;
+		if (node->nrattrs < prev->nrattrs) {
+			i = snap->attrs[prev->attr + node->nrattrs].name;
+			if (!strcmp(snapshot_name(snap, i), name))
+				return i;
+		}
+	}
+
+	for (i = 0; i < snap->nrnames; i++)
+		if (!strcmp(snapshot_name(snap, i), name))
+			return i;
+
+	names = realloc(snap->names, snap->namesize + len);
+	if (!names)
+		return -1;
+	snap->names = names;
+
+	nameoff = realloc(snap->nameoff, sizeof(*nameoff) * (i + 1));
+	if (!nameoff)
+		return -1;
+	snap->nameoff = nameoff;
+
+	memcpy(snap->names + snap->namesize, name, len);
+	snap->nameoff[i] = snap->namesize;
+	snap->namesize += len;
+	snap->nrnames++;
+
+	return i;
+}
+
+/*
+ * Add a node to the snapshot, the attributes added after belong to it.
+ *
+ * @path : the path identifying the node
+ * Returns 0 on success, -1 otherwise
+ */
+int snapshot_node(struct snapshot *snap, const char *path)
+{
+	struct snapshot_node *node;
+	int64_t offset;
+
+	if (snapshot_grow((void **)&snap->nodes, snap->nrnodes,
+			  &snap->maxnodes, sizeof(*snap->nodes)))
+		return -1;
+
+	offset = snapshot_pool_add(snap, path);
+	if (offset < 0)
+		return -1;
+
+	node = &snap->nodes[snap->nrnodes++];
+	node->path = offset;
+	node->attr = snap->nrattrs;
+	node->nrattrs = 0;
+
+	return 0;
+}
+
+static int snapshot_attr(struct snapshot *snap, const char *name,
+			 uint32_t type, int64_t value)
+{
+	struct snapshot_attr *attr;
+	int id;
+
+	if (!snap->nrnodes)
+		return -1;
+
+	if (snapshot_grow((void **)&snap->attrs, snap->nrattrs,
+			  &snap->maxattrs, sizeof(*snap->attrs)))
+		return -1;
+
+	id = snapshot_name_id(snap, name);
+	if (id < 0)
+		return -1;
+
+	attr = &snap->attrs[snap->nrattrs++];
+	attr->name = id;
+	attr->type = type;
+	attr->value = value;
+
+	snap->nodes[snap->nrnodes - 1].nrattrs++;
+
+	return 0;
+}
+
+int snapshot_int(struct snapshot *snap, const char *name, int64_t value)
+{
+	return snapshot_attr(snap, name, SNAPSHOT_INT, value);
+}
+
+int snapshot_string(struct snapshot *snap, const char *name,
+		    const char *value)
+{
+	int64_t offset;
+
+	offset = snapshot_pool_add(snap, value);
+	if (offset < 0)
+		return -1;
+
+	return snapshot_attr(snap, name, SNAPSHOT_STRING, offset);
+}
+
+/*
+ * Write the snapshot in a file.
+ *
+ * @path : the file to be written
+ * Returns 0 on success, -1 otherwise
+ */
+int snapshot_write(struct snapshot *snap, const char *path)
+{
+	struct snapshot_header header = {
+		.magic     = SNAPSHOT_MAGIC,
+		.version   = SNAPSHOT_VERSION,
+		.byteorder = SNAPSHOT_BYTEORDER,
+		.nrnames   = snap->nrnames,
+		.namesize  = snap->namesize,
+		.poolsize  = snap->poolsize,
+		.nrnodes   = snap->nrnodes,
+		.nrattrs   = snap->nrattrs,
+	};
+	FILE *f;
+	int ret = 0;
+
+	f = fopen(path, "w");
+	if (!f)
+		return -1;
+
+	if (fwrite(&header, sizeof(header), 1, f) != 1 ||
+	    fwrite(snap->names, 1, snap->namesize, f) != snap->namesize ||
+	    fwrite(snap->pool, 1, snap->poolsize, f) != snap->poolsize ||
+	    fwrite(snap->nodes, sizeof(*snap->nodes), snap->nrnodes, f) !=
+	    snap->nrnodes ||
+	    fwrite(snap->attrs, sizeof(*snap->attrs), snap->nrattrs, f) !=
+	    snap->nrattrs)
+		ret = -1;
+
+	if (fclose(f))
+		ret = -1;
+
+	return ret;
+}
+
+/*
+ * Check the offsets found in a snapshot read from a file, so they can
+ * be used without further check.
+ */
+static int snapshot_check(struct snapshot *snap)
+{
+	struct snapshot_node *node;
+	struct snapshot_attr *attr;
+	unsigned int i;
+
+	if ((snap->namesize && snap->names[snap->namesize - 1]) ||
+	    (snap->poolsize && snap->pool[snap->poolsize - 1]))
+		return -1;
+
+	for (i = 0; i < snap->nrnodes; i++) {
+		node = &snap->nodes[i];
+		if (node->path >= snap->poolsize ||
+		    node->attr > snap->nrattrs ||
+		    node->nrattrs > snap->nrattrs - node->attr)
+			return -1;
+	}
+
+	for (i = 0; i < snap->nrattrs; i++) {
+		attr = &snap->attrs[i];
+		if (attr->name >= snap->nrnames)
+			return -1;
+		if (attr->type == SNAPSHOT_STRING &&
+		    (attr->value < 0 || attr->value >= snap->poolsize))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Read a snapshot written by snapshot_write.
+ *
+ * @path : the file to be read
+ * Returns the snapshot on success, NULL otherwise
+ */
+struct snapshot *snapshot_read(const char *path)
+{
+	struct snapshot_header header;
+	struct snapshot *snap;
+	char *buf = NULL, *p;
+	size_t size = 0, expected;
+	ssize_t len;
+	unsigned int i, off;
+
+	len = file_read_buffer(path, &buf, &size);
+	if (len < (ssize_t)sizeof(header))
+		goto out_free_buf;
+
+	memcpy(&header, buf, sizeof(header));
+
+	if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) ||
+	    header.version != SNAPSHOT_VERSION ||
+	    header.byteorder != SNAPSHOT_BYTEORDER)
+		goto out_free_buf;
+
+	/*
+	 * Bound every count by the file size before computing the
+	 * expected size, so the sums and the allocations below can't
+	 * wrap. A name takes at least its nul terminator.
+	 */
+	len -= sizeof(header);
+	if (header.namesize > len || header.poolsize > len ||
+	    header.nrnames > header.namesize ||
+	    header.nrnodes > len / sizeof(struct snapshot_node) ||
+	    header.nrattrs > len / sizeof(struct snapshot_attr))
+		goto out_free_buf;
+
+	expected = (size_t)header.namesize + header.poolsize;
+	if (expected > len)
+		goto out_free_buf;
+	expected += (size_t)header.nrnodes * sizeof(struct snapshot_node);
+	if (expected > len)
+		goto out_free_buf;
+	expected += (size_t)header.nrattrs * sizeof(struct snapshot_attr);
+	if (len != expected)
+		goto out_free_buf;
+
+	snap = snapshot_alloc();
+	if (!snap)
+		goto out_free_buf;
+
+	snap->nrnames = header.nrnames;
+	snap->namesize = header.namesize;
+	snap->poolsize = snap->poolmax = header.poolsize;
+	snap->nrnodes = snap->maxnodes = header.nrnodes;
+	snap->nrattrs = snap->maxattrs = header.nrattrs;
+
+	snap->names = malloc(snap->namesize + 1);
+	snap->nameoff = malloc(sizeof(*snap->nameoff) *
+			       ((size_t)snap->nrnames + 1));
+	snap->pool = malloc(snap->poolsize + 1);
+	snap->nodes = malloc(sizeof(*snap->nodes) *
+			     ((size_t)snap->nrnodes + 1));
+	snap->attrs = malloc(sizeof(*snap->attrs) *
+			     ((size_t)snap->nrattrs + 1));
+	if (!snap->names || !snap->nameoff || !snap->pool ||
+	    !snap->nodes || !snap->attrs)
+		goto out_free_snap;
+
+	p = buf + sizeof(header);
+	memcpy(snap->names, p, snap->namesize);
+	p += snap->namesize;
+	memcpy(snap->pool, p, snap->poolsize);
+	p += snap->poolsize;
+	memcpy(snap->nodes, p, sizeof(*snap->nodes) * snap->nrnodes);
+	p += sizeof(*snap->nodes) * snap->nrnodes;
+	memcpy(snap->attrs, p, sizeof(*snap->attrs) * snap->nrattrs);
+
+	/* the dictionary is a sequence of nul terminated strings */
+	for (i = 0, off = 0; i < snap->nrnames; i++) {
+		if (off >= snap->namesize)
+			goto out_free_snap;
+		snap->nameoff[i] = off;
+		off += strlen(snap->names + off) + 1;
+	}
+
+	if (snapshot_check(snap))
+		goto out_free_snap;
+
+	free(buf);
+
+	return snap;
+
+out_free_snap:
+	snapshot_free(snap);
+out_free_buf:
+	free(buf);
+	return NULL;
+}
+
+static const char *snapshot_value(struct snapshot *snap,
+				  struct snapshot_attr *attr,
+				  char *buf, size_t len)
+{
+	if (attr->type == SNAPSHOT_STRING)
+		return snap->pool + attr->value;
+
+	snprintf(buf, len, "%" PRId64, attr->value);
+
+	return buf;
+}
+
+/*
+ * Compare the attributes of a node present in both snapshots. The
+ * dictionaries of the snapshots may differ, the names are compared
+ * through the mapping of the names of b to the names of a.
+ */
+static int snapshot_diff_node(struct snapshot *a, struct snapshot_node *na,
+			      struct snapshot *b, struct snapshot_node *nb,
+			      const int *map, snapshot_diff_cb_t cb, void *data)
+{
+	struct snapshot_attr *aa = &a->attrs[na->attr];
+	struct snapshot_attr *ab = &b->attrs[nb->attr];
+	const char *path = b->pool + nb->path;
+	char bufa[32], bufb[32];
+	unsigned int i, j;
+	bool found;
+
+	for (j = 0; j < nb->nrattrs; j++) {
+
+		found = false;
+
+		for (i = 0; i < na->nrattrs; i++) {
+
+			if (aa[i].name != map[ab[j].name])
+				continue;
+
+			found = true;
+
+			if (aa[i].type == ab[j].type &&
+			    (aa[i].type == SNAPSHOT_INT ?
+			     aa[i].value == ab[j].value :
+			     !strcmp(a->pool + aa[i].value,
+				     b->pool + ab[j].value)))
+				break;
+
+			if (cb(SNAPSHOT_CHANGED, path,
+			       snapshot_name(b, ab[j].name),
+			       snapshot_value(a, &aa[i], bufa, sizeof(bufa)),
+			       snapshot_value(b, &ab[j], bufb, sizeof(bufb)),
+			       data))
+				return -1;
+			break;
+		}
+
+		if (!found &&
+		    cb(SNAPSHOT_CHANGED, path, snapshot_name(b, ab[j].name), NULL,
+		       snapshot_value(b, &ab[j], bufb, sizeof(bufb)), data))
+			return -1;
+	}
+
+	/* the attributes which disappeared */
+	for (i = 0; i < na->nrattrs; i++) {
+
+		for (j = 0; j < nb->nrattrs; j++)
+			if (aa[i].name == map[ab[j].name])
+				break;
+
+		if (j == nb->nrattrs &&
+		    cb(SNAPSHOT_CHANGED, path, snapshot_name(a, aa[i].name),
+		       snapshot_value(a, &aa[i], bufa, sizeof(bufa)), NULL,
+		       data))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Compare two snapshots and call the callback for each difference: the
+ * nodes added in b, the nodes removed from a and the attributes which
+ * changed for the nodes present in both.
+ *
+ * @a  : the reference snapshot
+ * @b  : the snapshot compared to the reference
+ * @cb : called for each difference, stops the comparison if not 0
+ * Returns 0 on success, < 0 otherwise
+ */
+int snapshot_diff(struct snapshot *a, struct snapshot *b,
+		  snapshot_diff_cb_t cb, void *data)
+{
+	struct snapshot_node *na, *nb;
+	struct hash *h;
+	bool *matched;
+	int *map;
+	unsigned int i, j;
+	int ret = -1;
+
+	h = hash_create(a->nrnodes);
+	matched = calloc(a->nrnodes + 1, sizeof(*matched));
+	map = malloc(sizeof(*map) * (b->nrnames + 1));
+	if (!h || !matched || !map)
+		goto out;
+
+	for (i = 0; i < b->nrnames; i++) {
+		map[i] = -1;
+		for (j = 0; j < a->nrnames; j++)
+			if (!strcmp(snapshot_name(a, j), snapshot_name(b, i))) {
+				map[i] = j;
+				break;
+			}
+	}
+
+	for (i = 0; i < a->nrnodes; i++)
+		if (hash_add(h, a->pool + a->nodes[i].path, &a->nodes[i]))
+			goto out;
+
+	for (i = 0; i < b->nrnodes; i++) {
+
+		const char *path = b->pool + b->nodes[i].path;
+
+		nb = &b->nodes[i];
+		na = hash_find(h, path, strlen(path));
+
+		if (!na) {
+			if (cb(SNAPSHOT_ADDED, path, NULL, NULL, NULL, data))
+				goto out;
+			continue;
+		}
+
+		matched[na - a->nodes] = true;
+
+		if (snapshot_diff_node(a, na, b, nb, map, cb, data))
+			goto out;
+	}
+
+	for (i = 0; i < a->nrnodes; i++)
+		if (!matched[i] && cb(SNAPSHOT_REMOVED,
+				      a->pool + a->nodes[i].path,
+				      NULL, NULL, NULL, data))
+			goto out;
+
+	ret = 0;
+out:
+	free(map);
+	free(matched);
+	hash_free(h);
+
+	return ret;
+}
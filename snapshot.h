@@ -0,0 +1,50 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+#ifndef __SNAPSHOT_H
+#define __SNAPSHOT_H
+
+#include <stdint.h>
+
+struct snapshot;
+
+enum snapshot_change {
+	SNAPSHOT_ADDED,
+	SNAPSHOT_REMOVED,
+	SNAPSHOT_CHANGED,
+};
+
+/*
+ * Called for each difference found by snapshot_diff. For an added or
+ * removed node, attr, old and new are NULL. For a changed attribute,
+ * old or new is NULL if the attribute is missing in one snapshot.
+ */
+typedef int (*snapshot_diff_cb_t)(enum snapshot_change change,
+				  const char *path, const char *attr,
+				  const char *old, const char *new, void *data);
+
+extern struct snapshot *snapshot_alloc(void);
+extern void snapshot_free(struct snapshot *snap);
+extern unsigned int snapshot_nrnodes(struct snapshot *snap);
+
+extern int snapshot_node(struct snapshot *snap, const char *path);
+extern int snapshot_int(struct snapshot *snap, const char *name,
+			int64_t value);
+extern int snapshot_string(struct snapshot *snap, const char *name,
+			   const char *value);
+
+extern int snapshot_write(struct snapshot *snap, const char *path);
+extern struct snapshot *snapshot_read(const char *path);
+
+extern int snapshot_diff(struct snapshot *a, struct snapshot *b,
+			 snapshot_diff_cb_t cb, void *data);
+
+#endif
@@ -0,0 +1,461 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * The suspend statistics and the changes brought by each suspend cycle.
+ * Only the success and fail counters are polled, through held file
+ * descriptors, from a timer of the main loop so the cycles are seen
+ * whatever the panel showed. When they change, the other statistics
+ * are read and the state given by the capture callback is compared
+ * with the one captured after the previous cycle, or at start. The
+ * differences are kept in a bounded history of the last cycles.
+ *
+ * Nothing tells a cycle is about to start, so the differences of a
+ * cycle are the changes since the previous one: the changes made while
+ * the system was running are included with the ones of the cycle.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#undef _GNU_SOURCE
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/timerfd.h>
+
+#include "powerdebug.h"
+#include "display.h"
+#include "mainloop.h"
+#include "suspend.h"
+#include "snapshot.h"
+#include "utils.h"
+
+#define SYSFS_POWER "/sys/power"
+#define SYSFS_SUSPEND_STATS SYSFS_POWER "/suspend_stats"
+
+#define SUSPEND_POLL_SEC 1
+#define SUSPEND_HISTORY 16
+#define SUSPEND_CHANGES_MAX 32
+
+/* the counters of suspend_stats, the hw sleep ones are recent */
+static const char *suspend_counters[] = {
+	"success",
+	"fail",
+	"failed_freeze",
+	"failed_prepare",
+	"failed_suspend",
+	"failed_suspend_late",
+	"failed_suspend_noirq",
+	"failed_resume",
+	"failed_resume_early",
+	"failed_resume_noirq",
+	"last_failed_errno",
+	"last_hw_sleep",
+	"total_hw_sleep",
+	"max_hw_sleep",
+};
+
+#define SUSPEND_NRCOUNTERS \
+	(sizeof(suspend_counters) / sizeof(suspend_counters[0]))
+
+enum {
+	SUSPEND_SUCCESS,
+	SUSPEND_FAIL,
+};
+
+/*
+ * A suspend cycle, or several ones between two polls
+ *
+ * successes, failures : the number of cycles which succeeded or failed
+ * changes   : the differences of the state, up to SUSPEND_CHANGES_MAX
+ * nrchanges : the number of differences, including the ones not kept
+ */
+struct suspend_cycle {
+	time_t date;
+	int successes;
+	int failures;
+	char failed_step[32];
+	char failed_dev[64];
+	long long wakeup_count;
+	char *changes[SUSPEND_CHANGES_MAX];
+	int nrchanges;
+};
+
+static int suspend_fds[SUSPEND_NRCOUNTERS];
+static long long suspend_values[SUSPEND_NRCOUNTERS];
+static char suspend_failed_step[32];
+static char suspend_failed_dev[64];
+static long long suspend_wakeup_count = -1;
+
+static struct suspend_cycle suspend_history[SUSPEND_HISTORY];
+static int suspend_nrcycles;
+
+static suspend_capture_t suspend_capture;
+static void *suspend_capture_data;
+static struct snapshot *suspend_baseline;
+
+static bool suspend_error = false;
+
+/*
+ * Reading wakeup_count blocks while wakeup events are being processed,
+ * it is only read when a cycle has just completed and at start.
+ */
+static void suspend_read_wakeup_count(void)
+{
+	long long value;
+
+	if (!file_read_value(SYSFS_POWER, "wakeup_count", "%lld", &value))
+		suspend_wakeup_count = value;
+}
+
+static void suspend_read_stats(void)
+{
+	unsigned int i;
+
+	for (i = SUSPEND_FAIL + 1; i < SUSPEND_NRCOUNTERS; i++)
+		if (suspend_fds[i] >= 0)
+			fd_read_value(suspend_fds[i], &suspend_values[i]);
+
+	file_read_value(SYSFS_SUSPEND_STATS, "last_failed_step", "%31s",
+			suspend_failed_step);
+	file_read_value(SYSFS_SUSPEND_STATS, "last_failed_dev", "%63s",
+			suspend_failed_dev);
+
+	suspend_read_wakeup_count();
+}
+
+static int suspend_diff_cb(enum snapshot_change change, const char *path,
+			   const char *attr, const char *old,
+			   const char *new, void *data)
+{
+	struct suspend_cycle *cycle = data;
+	char **line;
+	int ret = 0;
+
+	if (cycle->nrchanges >= SUSPEND_CHANGES_MAX) {
+		cycle->nrchanges++;
+		return 0;
+	}
+
+	line = &cycle->changes[cycle->nrchanges];
+
+	switch (change) {
+	case SNAPSHOT_ADDED:
+		ret = asprintf(line, "+ %s", path);
+		break;
+	case SNAPSHOT_REMOVED:
+		ret = asprintf(line, "- %s", path);
+		break;
+	case SNAPSHOT_CHANGED:
+		ret = asprintf(line, "~ %s %s: %s -> %s", path, attr,
+			       old ? old : "(none)", new ? new : "(none)");
+		break;
+	}
+
+	if (ret < 0)
+		return -1;
+
+	cycle->nrchanges++;
+
+	return 0;
+}
+
+static struct snapshot *suspend_capture_state(void)
+{
+	struct snapshot *snap;
+
+	snap = snapshot_alloc();
+	if (!snap)
+		return NULL;
+
+	if (suspend_capture(snap, suspend_capture_data)) {
+		snapshot_free(snap);
+		return NULL;
+	}
+
+	return snap;
+}
+
+/*
+ * Capture the state after a cycle and compare it with the state after
+ * the previous one
+ */
+static int suspend_capture_diff(struct suspend_cycle *cycle)
+{
+	struct snapshot *snap;
+	int ret = 0;
+
+	if (!suspend_capture)
+		return 0;
+
+	snap = suspend_capture_state();
+	if (!snap)
+		return -1;
+
+	if (suspend_baseline) {
+		ret = snapshot_diff(suspend_baseline, snap,
+				    suspend_diff_cb, cycle);
+		snapshot_free(suspend_baseline);
+	}
+
+	/* the state after this cycle is the one before the next */
+	suspend_baseline = snap;
+
+	return ret;
+}
+
+static void suspend_cycle_free(struct suspend_cycle *cycle)
+{
+	int i;
+
+	for (i = 0; i < cycle->nrchanges && i < SUSPEND_CHANGES_MAX; i++)
+		free(cycle->changes[i]);
+
+	memset(cycle, 0, sizeof(*cycle));
+}
+
+static int suspend_new_cycle(long long success, long long fail)
+{
+	struct suspend_cycle *cycle;
+
+	/* the oldest cycle is replaced */
+	cycle = &suspend_history[suspend_nrcycles % SUSPEND_HISTORY];
+	suspend_cycle_free(cycle);
+	suspend_nrcycles++;
+
+	cycle->date = time(NULL);
+	cycle->successes = success - suspend_values[SUSPEND_SUCCESS];
+	cycle->failures = fail - suspend_values[SUSPEND_FAIL];
+
+	suspend_values[SUSPEND_SUCCESS] = success;
+	suspend_values[SUSPEND_FAIL] = fail;
+
+	suspend_read_stats();
+
+	if (cycle->failures) {
+		strcpy(cycle->failed_step, suspend_failed_step);
+		strcpy(cycle->failed_dev, suspend_failed_dev);
+	}
+	cycle->wakeup_count = suspend_wakeup_count;
+
+	return suspend_capture_diff(cycle);
+}
+
+/*
+ * Poll the success and fail counters, the only files read when there
+ * is no new cycle.
+ * Returns 1 if a cycle was found, 0 if not, -1 on error
+ */
+static int suspend_poll(void)
+{
+	long long success, fail;
+
+	/* the state before the first cycle, once the subsystems are read */
+	if (suspend_capture && !suspend_baseline)
+		suspend_baseline = suspend_capture_state();
+
+	if (suspend_fds[SUSPEND_SUCCESS] < 0 ||
+	    fd_read_value(suspend_fds[SUSPEND_SUCCESS], &success) ||
+	    fd_read_value(suspend_fds[SUSPEND_FAIL], &fail))
+		return -1;
+
+	if (success == suspend_values[SUSPEND_SUCCESS] &&
+	    fail == suspend_values[SUSPEND_FAIL])
+		return 0;
+
+	return suspend_new_cycle(success, fail) ? -1 : 1;
+}
+
+static int suspend_timer(int fd, void *data)
+{
+	uint64_t expirations;
+
+	if (read(fd, &expirations, sizeof(expirations)) < 0)
+		return 0;
+
+	suspend_poll();
+
+	return 0;
+}
+
+static int suspend_print_info(void)
+{
+	struct suspend_cycle *cycle;
+	char date[32];
+	unsigned int i;
+	int c, n, line = 0;
+	char *buf;
+
+	display_reset_cursor(SUSPEND);
+
+	if (asprintf(&buf, "%-24s %s", "Name", "Value") < 0)
+		return -1;
+	display_column_name(buf);
+	free(buf);
+
+	for (i = 0; i < SUSPEND_NRCOUNTERS; i++)
+		if (suspend_fds[i] >= 0)
+			display_printf_line(SUSPEND, &line, false, NULL,
+					    "%-24s %lld", suspend_counters[i],
+					    suspend_values[i]);
+
+	display_printf_line(SUSPEND, &line, false, NULL, "%-24s %s",
+			    "last_failed_step", suspend_failed_step);
+	display_printf_line(SUSPEND, &line, false, NULL, "%-24s %s",
+			    "last_failed_dev", suspend_failed_dev);
+	display_printf_line(SUSPEND, &line, false, NULL, "%-24s %lld",
+			    "wakeup_count", suspend_wakeup_count);
+
+	display_printf_line(SUSPEND, &line, true, NULL,
+			    "Last cycles, with the changes since the previous "
+			    "cycle or the start");
+	display_printf_line(SUSPEND, &line, true, NULL,
+			    "%-24s %-10s %-10s %-10s %s", "Cycle", "Success",
+			    "Fail", "Changes", "Failed step/device");
+
+	/* the last cycles, the most recent first */
+	n = suspend_nrcycles < SUSPEND_HISTORY ?
+		suspend_nrcycles : SUSPEND_HISTORY;
+
+	for (c = 0; c < n; c++) {
+
+		cycle = &suspend_history[(suspend_nrcycles - 1 - c) %
+					 SUSPEND_HISTORY];
+
+		strftime(date, sizeof(date), "%F %T",
+			 localtime(&cycle->date));
+
+		display_printf_line(SUSPEND, &line, cycle->failures, NULL,
+				    "%-24s %-10d %-10d %-10d %s %s", date,
+				    cycle->successes, cycle->failures,
+				    cycle->nrchanges, cycle->failed_step,
+				    cycle->failed_dev);
+
+		for (i = 0; i < cycle->nrchanges && i < SUSPEND_CHANGES_MAX;
+		     i++)
+			display_printf_line(SUSPEND, &line, false, NULL,
+					    "  %s", cycle->changes[i]);
+	}
+
+	display_refresh_pad(SUSPEND);
+
+	return 0;
+}
+
+static int suspend_display(bool refresh)
+{
+	if (suspend_error) {
+		display_message(SUSPEND,
+			"error: path " SYSFS_SUSPEND_STATS " not found");
+		return -2;
+	}
+
+	if (refresh && suspend_poll() < 0)
+		return -1;
+
+	return suspend_print_info();
+}
+
+int suspend_dump(void)
+{
+	unsigned int i;
+
+	printf("\nSuspend Statistics:\n");
+	printf("*******************\n");
+
+	suspend_read_stats();
+
+	for (i = 0; i < SUSPEND_NRCOUNTERS; i++)
+		if (suspend_fds[i] >= 0)
+			printf("%s: %lld\n", suspend_counters[i],
+			       suspend_values[i]);
+
+	printf("last_failed_step: %s\n", suspend_failed_step);
+	printf("last_failed_dev: %s\n", suspend_failed_dev);
+	printf("wakeup_count: %lld\n", suspend_wakeup_count);
+
+	return 0;
+}
+
+int suspend_snapshot(struct snapshot *snap)
+{
+	unsigned int i;
+
+	if (snapshot_node(snap, SYSFS_SUSPEND_STATS))
+		return -1;
+
+	for (i = 0; i < SUSPEND_NRCOUNTERS; i++)
+		if (suspend_fds[i] >= 0 &&
+		    snapshot_int(snap, suspend_counters[i], suspend_values[i]))
+			return -1;
+
+	return 0;
+}
+
+static int suspend_timer_init(void)
+{
+	struct itimerspec its = {
+		.it_value    = { .tv_sec = SUSPEND_POLL_SEC },
+		.it_interval = { .tv_sec = SUSPEND_POLL_SEC },
+	};
+	int fd;
+
+	fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0)
+		return -1;
+
+	if (timerfd_settime(fd, 0, &its, NULL) ||
+	    mainloop_add(fd, suspend_timer, NULL)) {
+		close(fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+static struct display_ops suspend_ops = {
+	.display = suspend_display,
+};
+
+int suspend_init(suspend_capture_t capture, void *data)
+{
+	unsigned int i;
+	int ret;
+
+	ret = display_register(SUSPEND, &suspend_ops);
+	if (ret)
+		printf("error: suspend display register failed");
+
+	if (access(SYSFS_SUSPEND_STATS, F_OK)) {
+		suspend_error = true; /* set the flag */
+		return -1;
+	}
+
+	for (i = 0; i < SUSPEND_NRCOUNTERS; i++) {
+		suspend_fds[i] = file_open_value(SYSFS_SUSPEND_STATS,
+						 suspend_counters[i]);
+		if (suspend_fds[i] >= 0)
+			fd_read_value(suspend_fds[i], &suspend_values[i]);
+	}
+
+	suspend_read_stats();
+
+	suspend_capture = capture;
+	suspend_capture_data = data;
+
+	if (suspend_timer_init())
+		return -1;
+
+	return ret;
+}
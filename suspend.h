@@ -0,0 +1,26 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+struct snapshot;
+
+/*
+ * Capture the state compared from a suspend cycle to the next one
+ *
+ * @snap : the snapshot to be filled
+ * @data : the private data given to suspend_init
+ * Returns 0 on success, -1 otherwise
+ */
+typedef int (*suspend_capture_t)(struct snapshot *snap, void *data);
+
+extern int suspend_init(suspend_capture_t capture, void *data);
+extern int suspend_dump(void);
+extern int suspend_snapshot(struct snapshot *snap);
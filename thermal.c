@@ -0,0 +1,516 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * The thermal zones with their trip points and the cooling devices
+ * bound to them. The trip points and the bindings are read once, the
+ * zone temperatures and the cooling device states are read through
+ * held file descriptors. The time spent by a cooling device in each
+ * state is accounted between two refreshes, the previous state being
+ * assumed to have lasted for the whole interval.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#undef _GNU_SOURCE
+#include <stdbool.h>
+#include <dirent.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <limits.h>
+
+#include "powerdebug.h"
+#include "display.h"
+#include "thermal.h"
+#include "tree.h"
+#include "snapshot.h"
+#include "utils.h"
+
+#define SYSFS_THERMAL "/sys/class/thermal"
+
+#define VALUE_MAX 32
+
+struct thermal_trip {
+	char type[VALUE_MAX];
+	long long temp;
+};
+
+/*
+ * A cooling device
+ *
+ * fd        : the cur_state attribute, kept opened
+ * residency : the time spent in each state, in microseconds
+ * sampled   : the time of the last reading
+ */
+struct cooling_device {
+	char type[NAME_MAX];
+	int fd;
+	long long state;
+	long long max_state;
+	uint64_t *residency;
+	uint64_t sampled;
+	uint64_t elapsed;
+	int nrtransitions;
+};
+
+/* A cooling device bound to a trip point of a zone */
+struct thermal_binding {
+	struct tree *cdev;
+	int trip;
+};
+
+/*
+ * A thermal zone
+ *
+ * fd       : the temp attribute, kept opened
+ * trips    : the trip points
+ * bindings : the cooling devices bound to the zone
+ */
+struct thermal_zone {
+	char type[NAME_MAX];
+	char policy[VALUE_MAX];
+	int fd;
+	long long temp;
+	int nrtrips;
+	struct thermal_trip *trips;
+	int nrbindings;
+	struct thermal_binding *bindings;
+};
+
+static struct tree *zone_tree;
+static struct tree *cdev_tree;
+static bool thermal_error = false;
+
+static const char * const zone_shape[] = { "thermal_zone*", NULL };
+static const char * const cdev_shape[] = { "cooling_device*", NULL };
+
+/*
+ * Account the time spent in the previous state and read the new one.
+ */
+static int read_cdev_cb(struct tree *t, void *data)
+{
+	struct cooling_device *cdev = t->private;
+	uint64_t *now = data, delta;
+	long long state;
+
+	if (!t->parent || cdev->fd < 0)
+		return 0;
+
+	if (fd_read_value(cdev->fd, &state))
+		return 0;
+
+	if (cdev->sampled) {
+		delta = *now - cdev->sampled;
+		if (cdev->state >= 0 && cdev->state <= cdev->max_state)
+			cdev->residency[cdev->state] += delta;
+		cdev->elapsed += delta;
+		if (state != cdev->state)
+			cdev->nrtransitions++;
+	}
+
+	cdev->sampled = *now;
+	cdev->state = state;
+
+	return 0;
+}
+
+static int read_zone_cb(struct tree *t, void *data)
+{
+	struct thermal_zone *zone = t->private;
+
+	if (t->parent && zone->fd >= 0)
+		fd_read_value(zone->fd, &zone->temp);
+
+	return 0;
+}
+
+static int read_thermal_info(void)
+{
+	uint64_t now = time_monotonic_us();
+
+	if (tree_for_each(zone_tree, read_zone_cb, NULL))
+		return -1;
+
+	return tree_for_each(cdev_tree, read_cdev_cb, &now);
+}
+
+static int thermal_display_zone(struct tree *t, void *data)
+{
+	struct thermal_zone *zone = t->private;
+	struct cooling_device *cdev;
+	struct thermal_binding *b;
+	int *line = data;
+	int i;
+
+	if (!t->parent)
+		return 0;
+
+	if (display_printf_line(THERMAL, line, true, t,
+				"%-20s %-20s %-10.1f %s", t->name, zone->type,
+				(double)zone->temp / 1000, zone->policy))
+		return -1;
+
+	for (i = 0; i < zone->nrtrips; i++)
+		if (display_printf_line(THERMAL, line, false, t,
+					"  trip %-13d %-20s %-10.1f", i,
+					zone->trips[i].type,
+					(double)zone->trips[i].temp / 1000))
+			return -1;
+
+	for (i = 0; i < zone->nrbindings; i++) {
+		b = &zone->bindings[i];
+		cdev = b->cdev->private;
+		if (display_printf_line(THERMAL, line, false, t,
+					"  %-18s %-20s state %lld/%lld, trip %d",
+					b->cdev->name, cdev->type, cdev->state,
+					cdev->max_state, b->trip))
+			return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * The residency of the states of a cooling device, the states never
+ * used are not showed
+ */
+static int thermal_display_cdev(struct tree *t, void *data)
+{
+	struct cooling_device *cdev = t->private;
+	int *line = data;
+	char residency[256];
+	size_t len = 0;
+	long long i;
+
+	if (!t->parent)
+		return 0;
+
+	residency[0] = '\0';
+
+	for (i = 0; i <= cdev->max_state && cdev->elapsed; i++) {
+		if (!cdev->residency[i])
+			continue;
+		len += snprintf(residency + len, sizeof(residency) - len,
+				"%lld:%.1f%% ", i, (double)cdev->residency[i] *
+				100 / cdev->elapsed);
+		if (len >= sizeof(residency))
+			break;
+	}
+
+	return display_printf_line(THERMAL, line, false, t,
+				   "%-20s %-20s %-10s %-12d %s", t->name,
+				   cdev->type, "", cdev->nrtransitions,
+				   residency);
+}
+
+static int thermal_print_header(void)
+{
+	char *buf;
+	int ret;
+
+	if (asprintf(&buf, "%-20s %-20s %-10s %s", "Name", "Type", "Temp C",
+		     "Policy / Transitions, residency per state") < 0)
+		return -1;
+
+	ret = display_column_name(buf);
+
+	free(buf);
+
+	return ret;
+}
+
+static int thermal_print_info(void)
+{
+	int ret, line = 0;
+
+	display_reset_cursor(THERMAL);
+
+	thermal_print_header();
+
+	ret = tree_for_each(zone_tree, thermal_display_zone, &line);
+	if (!ret)
+		ret = tree_for_each(cdev_tree, thermal_display_cdev, &line);
+
+	display_refresh_pad(THERMAL);
+
+	return ret;
+}
+
+static int thermal_display(bool refresh)
+{
+	if (thermal_error || !zone_tree) {
+		display_message(THERMAL,
+			"error: path " SYSFS_THERMAL " not found");
+		return -2;
+	}
+
+	if (refresh && read_thermal_info())
+		return -1;
+
+	return thermal_print_info();
+}
+
+static int thermal_dump_zone(struct tree *t, void *data)
+{
+	struct thermal_zone *zone = t->private;
+	struct cooling_device *cdev;
+	int i;
+
+	if (!t->parent)
+		return 0;
+
+	printf("\n%s:\n", t->name);
+	printf("\ttype: %s\n", zone->type);
+	printf("\ttemp: %.1f C\n", (double)zone->temp / 1000);
+	printf("\tpolicy: %s\n", zone->policy);
+
+	for (i = 0; i < zone->nrtrips; i++)
+		printf("\ttrip %d: %s %.1f C\n", i, zone->trips[i].type,
+		       (double)zone->trips[i].temp / 1000);
+
+	for (i = 0; i < zone->nrbindings; i++) {
+		cdev = zone->bindings[i].cdev->private;
+		printf("\t%s: %s state %lld/%lld, trip %d\n",
+		       zone->bindings[i].cdev->name, cdev->type, cdev->state,
+		       cdev->max_state, zone->bindings[i].trip);
+	}
+
+	return 0;
+}
+
+int thermal_dump(void)
+{
+	printf("\nThermal Information:\n");
+	printf("********************\n");
+
+	if (read_thermal_info())
+		return -1;
+
+	return tree_for_each(zone_tree, thermal_dump_zone, NULL);
+}
+
+static int thermal_snapshot_zone(struct tree *t, void *data)
+{
+	struct snapshot *snap = data;
+	struct thermal_zone *zone = t->private;
+
+	if (!t->parent)
+		return 0;
+
+	if (snapshot_node(snap, t->path) ||
+	    snapshot_string(snap, "type", zone->type) ||
+	    snapshot_string(snap, "policy", zone->policy) ||
+	    snapshot_int(snap, "temp", zone->temp))
+		return -1;
+
+	return 0;
+}
+
+static int thermal_snapshot_cdev(struct tree *t, void *data)
+{
+	struct snapshot *snap = data;
+	struct cooling_device *cdev = t->private;
+
+	if (!t->parent)
+		return 0;
+
+	if (snapshot_node(snap, t->path) ||
+	    snapshot_string(snap, "type", cdev->type) ||
+	    snapshot_int(snap, "cur_state", cdev->state) ||
+	    snapshot_int(snap, "max_state", cdev->max_state))
+		return -1;
+
+	return 0;
+}
+
+int thermal_snapshot(struct snapshot *snap)
+{
+	if (read_thermal_info())
+		return -1;
+
+	if (tree_for_each(zone_tree, thermal_snapshot_zone, snap))
+		return -1;
+
+	return tree_for_each(cdev_tree, thermal_snapshot_cdev, snap);
+}
+
+static int fill_cdev_cb(struct tree *t, void *data)
+{
+	struct cooling_device *cdev;
+
+	cdev = malloc(sizeof(*cdev));
+	if (!cdev)
+		return -1;
+	memset(cdev, 0, sizeof(*cdev));
+	cdev->fd = -1;
+	t->private = cdev;
+
+	if (!t->parent)
+		return 0;
+
+	file_read_value(t->path, "type", "%s", cdev->type);
+	file_read_value(t->path, "max_state", "%lld", &cdev->max_state);
+
+	if (cdev->max_state < 0)
+		cdev->max_state = 0;
+
+	cdev->residency = calloc(cdev->max_state + 1,
+				 sizeof(*cdev->residency));
+	if (!cdev->residency)
+		return -1;
+
+	cdev->fd = file_open_value(t->path, "cur_state");
+
+	return 0;
+}
+
+/*
+ * Read the trip points of a zone, they are numbered from 0 without hole
+ */
+static int thermal_read_trips(struct tree *t, struct thermal_zone *zone)
+{
+	struct thermal_trip trip, *trips;
+	char attr[64];
+
+	for (;;) {
+		snprintf(attr, sizeof(attr), "trip_point_%d_type",
+			 zone->nrtrips);
+		if (file_read_value(t->path, attr, "%31s", trip.type))
+			break;
+
+		snprintf(attr, sizeof(attr), "trip_point_%d_temp",
+			 zone->nrtrips);
+		trip.temp = 0;
+		file_read_value(t->path, attr, "%lld", &trip.temp);
+
+		trips = realloc(zone->trips, sizeof(*trips) *
+				(zone->nrtrips + 1));
+		if (!trips)
+			return -1;
+
+		zone->trips = trips;
+		zone->trips[zone->nrtrips++] = trip;
+	}
+
+	return 0;
+}
+
+/*
+ * The cooling devices bound to a zone are links named cdev<n> to the
+ * cooling device, with the trip point in cdev<n>_trip_point.
+ */
+static int thermal_read_bindings(struct tree *t, struct thermal_zone *zone)
+{
+	struct thermal_binding *bindings;
+	struct tree *cdev;
+	char attr[64], *path, link[PATH_MAX], *name;
+	ssize_t len;
+	int i, trip;
+
+	for (i = 0; ; i++) {
+
+		if (asprintf(&path, "%s/cdev%d", t->path, i) < 0)
+			return -1;
+
+		len = readlink(path, link, sizeof(link) - 1);
+		free(path);
+		if (len < 0)
+			break;
+		link[len] = '\0';
+
+		name = strrchr(link, '/');
+		name = name ? name + 1 : link;
+
+		cdev = tree_find(cdev_tree, name);
+		if (!cdev)
+			continue;
+
+		snprintf(attr, sizeof(attr), "cdev%d_trip_point", i);
+		trip = -1;
+		file_read_value(t->path, attr, "%d", &trip);
+
+		bindings = realloc(zone->bindings, sizeof(*bindings) *
+				   (zone->nrbindings + 1));
+		if (!bindings)
+			return -1;
+
+		zone->bindings = bindings;
+		zone->bindings[zone->nrbindings].cdev = cdev;
+		zone->bindings[zone->nrbindings].trip = trip;
+		zone->nrbindings++;
+	}
+
+	return 0;
+}
+
+static int fill_zone_cb(struct tree *t, void *data)
+{
+	struct thermal_zone *zone;
+
+	zone = malloc(sizeof(*zone));
+	if (!zone)
+		return -1;
+	memset(zone, 0, sizeof(*zone));
+	zone->fd = -1;
+	t->private = zone;
+
+	if (!t->parent)
+		return 0;
+
+	file_read_value(t->path, "type", "%s", zone->type);
+	file_read_value(t->path, "policy", "%31s", zone->policy);
+
+	zone->fd = file_open_value(t->path, "temp");
+
+	if (thermal_read_trips(t, zone))
+		return -1;
+
+	return thermal_read_bindings(t, zone);
+}
+
+static struct display_ops thermal_ops = {
+	.display = thermal_display,
+};
+
+int thermal_init(void)
+{
+	int ret;
+
+	ret = display_register(THERMAL, &thermal_ops);
+	if (ret)
+		printf("error: thermal display register failed");
+
+	if (access(SYSFS_THERMAL, F_OK)) {
+		thermal_error = true; /* set the flag */
+		return -1;
+	}
+
+	cdev_tree = tree_load_shape(SYSFS_THERMAL, cdev_shape, true);
+	if (!cdev_tree)
+		return -1;
+
+	zone_tree = tree_load_shape(SYSFS_THERMAL, zone_shape, true);
+	if (!zone_tree)
+		return -1;
+
+	if (tree_for_each(cdev_tree, fill_cdev_cb, NULL))
+		return -1;
+
+	if (tree_for_each(zone_tree, fill_zone_cb, NULL))
+		return -1;
+
+	if (read_thermal_info())
+		return -1;
+
+	return ret;
+}
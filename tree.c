@@ -23,8 +23,13 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fnmatch.h>
 
 #include "tree.h"
+#include "hash.h"
+
+/* Bound the walk whatever the links found in the directories */
+#define TREE_MAX_DEPTH 32
 
 /*
  * Allocate a tree structure and initialize the different fields.
@@ -59,6 +64,13 @@ static inline struct tree *tree_alloc(const char *path, int depth)
 	t->prev = NULL;
 	t->private = NULL;
 	t->nrchild = 0;
+	t->loaded = false;
+	t->enter = 0;
+	t->exit = 0;
+	t->order = NULL;
+	t->visited = NULL;
+	t->id[0] = 0;
+	t->id[1] = 0;
 
 	return t;
 }
@@ -105,77 +117,188 @@ static inline void tree_add_child(struct tree *parent, struct tree *child)
 }
 
 /*
- * This function will browse the directory structure and build a
- * tree reflecting the content of the directory tree.
+ * The parameters of a directory walk.
  *
- * @tree   : the root node of the tree
- * @filter : a callback to filter out the directories
+ * filter  : a callback to filter out the directories
+ * follow  : the symbolic links are followed
+ * visited : the directories already loaded, by device and inode number,
+ *           so a directory reached through several links is loaded once
+ *           and the symbolic link loops are not followed
+ * shape   : if set, the pattern the names must match at each level, the
+ *           directories of the last level are not opened
+ * depth   : the number of levels of the shape
+ */
+struct tree_walk {
+	tree_filter_t filter;
+	bool follow;
+	struct hash *visited;
+	const char * const *shape;
+	int depth;
+};
+
+static inline void tree_set_id(struct tree *t, struct stat *s)
+{
+	t->id[0] = s->st_dev;
+	t->id[1] = s->st_ino;
+}
+
+/*
+ * Tell if a directory entry is a node of the tree.
+ *
+ * @path   : the path of the directory being scanned
+ * @name   : the name of the entry
+ * @depth  : the depth of the entry in the tree
+ * @walk   : the parameters of the walk
+ * @newpath: filled with the full path of the entry, to be freed
+ * @s      : filled with the status of the directory
+ * Returns 1 if the entry is a node, 0 if it is not, -1 on error
+ */
+static int tree_is_node(const char *path, const char *name, int depth,
+			struct tree_walk *walk, char **newpath, struct stat *s)
+{
+	unsigned long long id[2];
+
+	if (name[0] == '.')
+		return 0;
+
+	if (walk->shape && fnmatch(walk->shape[depth - 1], name, 0))
+		return 0;
+
+	if (walk->filter && walk->filter(name))
+		return 0;
+
+	if (asprintf(newpath, "%s/%s", path, name) < 0)
+		return -1;
+
+	if (lstat(*newpath, s))
+		goto out;
+
+	if (S_ISLNK(s->st_mode) && (!walk->follow || stat(*newpath, s)))
+		goto out;
+
+	if (!S_ISDIR(s->st_mode))
+		goto out;
+
+	id[0] = s->st_dev;
+	id[1] = s->st_ino;
+
+	if (hash_find(walk->visited, (const char *)id, sizeof(id)))
+		goto out;
+
+	return 1;
+out:
+	free(*newpath);
+	return 0;
+}
+
+/*
+ * Count the children of a node without loading them.
+ *
+ * @tree : the node whose directory is counted
+ * @walk : the parameters of the walk
  * Returns 0 on success, -1 otherwise
  */
-static int tree_scan(struct tree *tree, tree_filter_t filter, bool follow)
+static int tree_count(struct tree *tree, struct tree_walk *walk)
 {
 	DIR *dir;
-	char *basedir, *newpath;
-	struct dirent dirent, *direntp;
+	struct dirent *direntp;
 	struct stat s;
+	char *newpath;
 	int ret = 0;
 
-	dir = opendir(tree->path);
-	if (!dir) {
-		printf("error: unable to open directory %s\n", tree->path);
-		return -1;
-	}
+	if (walk->shape && tree->depth >= walk->depth)
+		return 0;
 
-	while (!readdir_r(dir, &dirent, &direntp)) {
+	dir = opendir(tree->path);
+	if (!dir)
+		return 0;
 
-		struct tree *child;
+	while ((direntp = readdir(dir))) {
 
-                if (!direntp)
-                        break;
+		ret = tree_is_node(tree->path, direntp->d_name, tree->depth + 1,
+				   walk, &newpath, &s);
+		if (ret < 0)
+			break;
 
-                if (direntp->d_name[0] == '.')
-                        continue;
+		if (ret) {
+			tree->nrchild++;
+			free(newpath);
+		}
 
-		if (filter && filter(direntp->d_name))
-			continue;
+		ret = 0;
+	}
 
-		ret = asprintf(&basedir, "%s", tree->path);
-		if (ret < 0)
-			return -1;
+	closedir(dir);
 
-		ret = basename(basedir) ? 0 : -1;
-		if (ret < 0)
-			goto out_free_basedir;
+	return ret;
+}
 
-		ret = asprintf(&newpath, "%s/%s", basedir, direntp->d_name);
-		if (ret < 0)
-			goto out_free_basedir;
+/*
+ * This function will browse the directory structure and build a
+ * tree reflecting the content of the directory tree. The nodes deeper
+ * than TREE_MAX_DEPTH or than the shape of the walk are not loaded.
+ *
+ * @tree   : the root node of the tree
+ * @walk   : the parameters of the walk
+ * @levels : the number of levels to be loaded, < 0 for the whole tree,
+ *           the children of the last level are only counted
+ * Returns 0 on success, -1 otherwise
+ */
+static int tree_scan(struct tree *tree, struct tree_walk *walk, int levels)
+{
+	DIR *dir;
+	char *newpath;
+	struct dirent *direntp;
+	struct stat s;
+	int ret = 0;
 
-		ret = stat(newpath, &s);
-		if (ret)
-			goto out_free_newpath;
+	if (tree->depth >= TREE_MAX_DEPTH)
+		return 0;
 
-		if (S_ISDIR(s.st_mode) || (S_ISLNK(s.st_mode) && follow)) {
+	if (walk->shape && tree->depth >= walk->depth)
+		return 0;
 
-			ret = -1;
+	dir = opendir(tree->path);
+	if (!dir) {
+		printf("error: unable to open directory %s\n", tree->path);
+		return -1;
+	}
 
-			child = tree_alloc(newpath, tree->depth + 1);
-			if (!child)
-				goto out_free_newpath;
+	tree->loaded = true;
 
-			tree_add_child(tree, child);
+	while ((direntp = readdir(dir))) {
 
-			tree->nrchild++;
+		struct tree *child;
 
-			ret = tree_scan(child, filter, follow);
+		ret = tree_is_node(tree->path, direntp->d_name, tree->depth + 1,
+				   walk, &newpath, &s);
+		if (ret <= 0) {
+			if (ret)
+				break;
+			continue;
 		}
 
-	out_free_newpath:
+		ret = -1;
+
+		child = tree_alloc(newpath, tree->depth + 1);
 		free(newpath);
+		if (!child)
+			break;
 
-	out_free_basedir:
-		free(basedir);
+		tree_add_child(tree, child);
 
+		tree->nrchild++;
+
+		tree_set_id(child, &s);
+		if (hash_add_key(walk->visited, (const char *)child->id,
+				 sizeof(child->id), child))
+			break;
+
+		if (levels == 1)
+			ret = tree_count(child, walk);
+		else
+			ret = tree_scan(child, walk,
+					levels > 0 ? levels - 1 : levels);
 		if (ret)
 			break;
 	}
@@ -185,23 +308,129 @@ static int tree_scan(struct tree *tree, tree_filter_t filter, bool follow)
 	return ret;
 }
 
+/*
+ * Allocate the root node of a tree loaded from a directory, with the
+ * set of the visited directories.
+ */
+static struct tree *tree_alloc_root(const char *path)
+{
+	struct tree *tree;
+	struct stat s;
+
+	if (stat(path, &s)) {
+		printf("error: unable to open directory %s\n", path);
+		return NULL;
+	}
+
+	tree = tree_alloc(path, 0);
+	if (!tree)
+		return NULL;
+
+	tree->visited = hash_create(64);
+	if (!tree->visited)
+		goto out_free;
+
+	tree_set_id(tree, &s);
+	if (hash_add_key(tree->visited, (const char *)tree->id,
+			 sizeof(tree->id), tree))
+		goto out_free;
+
+	return tree;
+
+out_free:
+	hash_free(tree->visited);
+	tree_free(tree);
+	return NULL;
+}
+
 /*
  * This function takes the topmost directory path and populate the
  * directory tree structures.
  *
- * @tree : a path to the topmost directory path
+ * @tree   : a path to the topmost directory path
+ * @filter : a callback to filter out the directories
+ * @follow : the symbolic links to directories are followed, a directory
+ *           is loaded once whatever the number of links to it
  * Returns a tree structure corresponding to the root node of the
  * directory tree representation on success, NULL otherwise
  */
 struct tree *tree_load(const char *path, tree_filter_t filter, bool follow)
 {
 	struct tree *tree;
+	struct tree_walk walk = { filter, follow };
 
-	tree = tree_alloc(path, 0);
+	tree = tree_alloc_root(path);
+	if (!tree)
+		return NULL;
+
+	walk.visited = tree->visited;
+
+	if (tree_scan(tree, &walk, -1) || tree_index(tree)) {
+		hash_free(tree->visited);
+		tree_free(tree);
+		return NULL;
+	}
+
+	return tree;
+}
+
+/*
+ * Same as tree_load but the tree is limited to a given shape: a glob
+ * pattern, see fnmatch(3), for the names of each level. The tree is not
+ * deeper than the number of patterns and the directories of the last
+ * level are not opened, so a subsystem only loads what it needs.
+ *
+ * @path   : a path to the topmost directory path
+ * @shape  : the patterns of the levels, NULL terminated
+ * @follow : the symbolic links to directories are followed
+ * Returns the root node on success, NULL otherwise
+ */
+struct tree *tree_load_shape(const char *path, const char * const *shape,
+			     bool follow)
+{
+	struct tree *tree;
+	struct tree_walk walk = { NULL, follow, NULL, shape };
+
+	while (shape[walk.depth])
+		walk.depth++;
+
+	tree = tree_alloc_root(path);
+	if (!tree)
+		return NULL;
+
+	walk.visited = tree->visited;
+
+	if (tree_scan(tree, &walk, -1) || tree_index(tree)) {
+		hash_free(tree->visited);
+		tree_free(tree);
+		return NULL;
+	}
+
+	return tree;
+}
+
+/*
+ * Same as tree_load but only the first level of the tree is loaded,
+ * the deeper levels are loaded on demand with tree_expand. The number
+ * of children of the loaded nodes is always available.
+ *
+ * @tree : a path to the topmost directory path
+ * Returns the root node on success, NULL otherwise
+ */
+struct tree *tree_load_lazy(const char *path, tree_filter_t filter,
+			    bool follow)
+{
+	struct tree *tree;
+	struct tree_walk walk = { filter, follow };
+
+	tree = tree_alloc_root(path);
 	if (!tree)
 		return NULL;
 
-	if (tree_scan(tree, filter, follow)) {
+	walk.visited = tree->visited;
+
+	if (tree_scan(tree, &walk, 1) || tree_index(tree)) {
+		hash_free(tree->visited);
 		tree_free(tree);
 		return NULL;
 	}
@@ -209,6 +438,251 @@ struct tree *tree_load(const char *path, tree_filter_t filter, bool follow)
 	return tree;
 }
 
+/*
+ * Load the children of a node loaded with tree_load_lazy, nothing is
+ * done if they are already loaded.
+ *
+ * @tree : the node to be expanded
+ * Returns 0 on success, -1 otherwise
+ */
+int tree_expand(struct tree *tree, tree_filter_t filter, bool follow)
+{
+	struct tree *root;
+	struct tree_walk walk = { filter, follow };
+
+	if (tree->loaded)
+		return 0;
+
+	for (root = tree; root->parent; root = root->parent)
+		;
+
+	walk.visited = root->visited;
+
+	/* the children were counted, they are going to be added */
+	tree->nrchild = 0;
+
+	if (tree_scan(tree, &walk, 1))
+		return -1;
+
+	return tree_index(root);
+}
+
+static int tree_count_cb(struct tree *t, void *data)
+{
+	(*(int *)data)++;
+
+	return 0;
+}
+
+/*
+ * Number the nodes in depth first order, the descendants of a node have
+ * the indexes following the one of the node.
+ */
+static int tree_index_node(struct tree *t, struct tree **order, int index)
+{
+	struct tree *child;
+
+	t->enter = index;
+	order[index++] = t;
+
+	for (child = t->child; child; child = child->next)
+		index = tree_index_node(child, order, index);
+
+	t->exit = index - 1;
+
+	return index;
+}
+
+/*
+ * Build the ancestry index of a tree: each node gets its entry and exit
+ * indexes in the depth first order, so the ancestry between two nodes
+ * is checked in constant time and the nodes of a subtree are contiguous
+ * in the order array of the root. Must be called again when the tree
+ * changes, tree_load and tree_expand do it.
+ *
+ * @tree : the root node of the tree
+ * Returns 0 on success, -1 otherwise
+ */
+int tree_index(struct tree *tree)
+{
+	struct tree **order;
+	int nr = 0;
+
+	/* count the root and its descendants, not its siblings */
+	nr++;
+	tree_for_each(tree->child, tree_count_cb, &nr);
+
+	order = realloc(tree->order, sizeof(*order) * nr);
+	if (!order)
+		return -1;
+
+	tree->order = order;
+	tree_index_node(tree, order, 0);
+
+	return 0;
+}
+
+/*
+ * Returns true if a node is an ancestor of another node or the node
+ * itself, the tree must be indexed.
+ */
+bool tree_is_ancestor(struct tree *ancestor, struct tree *tree)
+{
+	return ancestor->enter <= tree->enter && tree->exit <= ancestor->exit;
+}
+
+/*
+ * Returns the lowest common ancestor of two nodes of an indexed tree,
+ * the ancestry check being constant, the cost is the depth of the tree.
+ */
+struct tree *tree_lca(struct tree *a, struct tree *b)
+{
+	while (a && !tree_is_ancestor(a, b))
+		a = a->parent;
+
+	return a;
+}
+
+/*
+ * Give the nodes of a subtree, the node included, in depth first order.
+ *
+ * @tree  : the topmost node of the subtree, in an indexed tree
+ * @nodes : filled with a pointer to the array of nodes, not to be freed
+ * Returns the number of nodes of the subtree
+ */
+int tree_subtree(struct tree *tree, struct tree ***nodes)
+{
+	struct tree *root;
+
+	for (root = tree; root->parent; root = root->parent)
+		;
+
+	*nodes = &root->order[tree->enter];
+
+	return tree->exit - tree->enter + 1;
+}
+
+/*
+ * Call a callback for the nodes of a subtree which are showed, in depth
+ * first order: the descendants of a collapsed node are contiguous in
+ * this order, they are skipped at once.
+ *
+ * @tree      : the topmost node of the subtree, in an indexed tree
+ * @collapsed : tells if the descendants of a node are hidden
+ * @cb        : the callback called for each node showed
+ * @data      : some private data passed to the callbacks
+ * Returns 0 on success, < 0 otherwise
+ */
+int tree_for_each_visible(struct tree *tree, tree_collapsed_t collapsed,
+			  tree_cb_t cb, void *data)
+{
+	struct tree **nodes;
+	int i, nr;
+
+	nr = tree_subtree(tree, &nodes);
+
+	for (i = 0; i < nr; i++) {
+
+		if (cb(nodes[i], data))
+			return -1;
+
+		if (collapsed(nodes[i]))
+			i += nodes[i]->exit - nodes[i]->enter;
+	}
+
+	return 0;
+}
+
+/*
+ * Create a node in memory, without any directory behind it, and add it
+ * as the last child of the parent node. This is used to build a tree
+ * from something else than a directory structure.
+ *
+ * @parent : the parent node or NULL to create a root node
+ * @name   : the name of the node, its path is built from the parent's one
+ * Returns the new node on success, NULL otherwise
+ */
+struct tree *tree_add_node(struct tree *parent, const char *name)
+{
+	struct tree *t;
+	char *path;
+
+	if (asprintf(&path, "%s/%s", parent ? parent->path : "", name) < 0)
+		return NULL;
+
+	t = tree_alloc(path, parent ? parent->depth + 1 : 0);
+	free(path);
+	if (!t)
+		return NULL;
+
+	if (parent) {
+		tree_add_child(parent, t);
+		parent->nrchild++;
+	}
+
+	return t;
+}
+
+static void tree_set_depth(struct tree *t, int depth)
+{
+	struct tree *child;
+
+	t->depth = depth;
+
+	for (child = t->child; child; child = child->next)
+		tree_set_depth(child, depth + 1);
+}
+
+/*
+ * Move a node with its descendants to the end of the children of
+ * another node. This is used to build a graph described by something
+ * else than the directory structure, the paths are not changed. The
+ * tree must be indexed again with tree_index.
+ *
+ * @t      : the node to be moved
+ * @parent : the new parent node, can't be a descendant of the node
+ * Returns 0 on success, -1 otherwise
+ */
+int tree_move(struct tree *t, struct tree *parent)
+{
+	struct tree *p, *head;
+
+	for (p = parent; p; p = p->parent)
+		if (p == t)
+			return -1;
+
+	if (t->parent) {
+		head = t->parent->child;
+
+		if (head == t) {
+			t->parent->child = t->next;
+			if (t->next) {
+				t->next->tail = t->tail;
+				t->next->prev = NULL;
+			}
+		} else {
+			t->prev->next = t->next;
+			if (t->next)
+				t->next->prev = t->prev;
+			else
+				head->tail = t->prev;
+		}
+
+		t->parent->nrchild--;
+	}
+
+	t->next = NULL;
+	t->prev = NULL;
+	t->tail = t;
+
+	tree_add_child(parent, t);
+	parent->nrchild++;
+
+	tree_set_depth(t, parent->depth + 1);
+
+	return 0;
+}
+
 /*
  * This function will go over the tree passed as parameter and
  * will call the callback passed as parameter for each node.
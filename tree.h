@@ -23,7 +23,15 @@
  * depth  : the recursive level of the node
  * path   : absolute pathname of the directory
  * name   : basename of the directory
+ * loaded : the children of the node are loaded
+ * enter  : index of the node in the depth first order of the tree
+ * exit   : index of the last descendant of the node in this order
+ * order  : for the root node, the nodes in depth first order
+ * visited: for the root node, the directories loaded in the tree
+ * id     : the device and inode numbers of the directory
  */
+struct hash;
+
 struct tree {
 	struct tree *tail;
 	struct tree *next;
@@ -35,14 +43,45 @@ struct tree {
 	void *private;
 	int   nrchild;
 	unsigned char depth;
+	bool loaded;
+	int enter;
+	int exit;
+	struct tree **order;
+	struct hash *visited;
+	unsigned long long id[2];
 };
 
 typedef int (*tree_cb_t)(struct tree *t, void *data);
 
 typedef int (*tree_filter_t)(const char *name);
 
+typedef bool (*tree_collapsed_t)(struct tree *t);
+
 extern struct tree *tree_load(const char *path, tree_filter_t filter, bool follow);
 
+extern struct tree *tree_load_shape(const char *path, const char * const *shape,
+				    bool follow);
+
+extern struct tree *tree_load_lazy(const char *path, tree_filter_t filter,
+				   bool follow);
+
+extern int tree_expand(struct tree *tree, tree_filter_t filter, bool follow);
+
+extern struct tree *tree_add_node(struct tree *parent, const char *name);
+
+extern int tree_move(struct tree *t, struct tree *parent);
+
+extern int tree_index(struct tree *tree);
+
+extern bool tree_is_ancestor(struct tree *ancestor, struct tree *tree);
+
+extern struct tree *tree_lca(struct tree *a, struct tree *b);
+
+extern int tree_subtree(struct tree *tree, struct tree ***nodes);
+
+extern int tree_for_each_visible(struct tree *tree, tree_collapsed_t collapsed,
+				 tree_cb_t cb, void *data);
+
 extern struct tree *tree_find(struct tree *tree, const char *name);
 
 extern int tree_for_each(struct tree *tree, tree_cb_t cb, void *data);
@@ -17,6 +17,13 @@
 #include <stdio.h>
 #undef _GNU_SOURCE
 #include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/resource.h>
 
 /*
  * This functions is a helper to read a specific file content and store
@@ -89,3 +96,161 @@ out_free:
 	free(rpath);
 	return ret;
 }
+
+/*
+ * Same as file_read_buffer with a file kept opened, the file is read
+ * from its beginning.
+ *
+ * @fd   : the file descriptor
+ * @buf  : a pointer to the buffer, pointing to NULL the first time
+ * @size : a pointer to the size of the buffer
+ * Returns the number of bytes read on success, -1 otherwise
+ */
+ssize_t fd_read_buffer(int fd, char **buf, size_t *size)
+{
+	ssize_t ret, len = 0;
+	char *newbuf;
+
+	for (;;) {
+
+		/* keep room for the nul character */
+		if (!*buf || len + 1 >= *size) {
+			newbuf = realloc(*buf, *size ? *size * 2 : 16384);
+			if (!newbuf) {
+				len = -1;
+				break;
+			}
+			*buf = newbuf;
+			*size = *size ? *size * 2 : 16384;
+		}
+
+		ret = pread(fd, *buf + len, *size - len - 1, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			len = -1;
+			break;
+		}
+
+		if (!ret)
+			break;
+
+		len += ret;
+	}
+
+	if (len >= 0)
+		(*buf)[len] = '\0';
+
+	return len;
+}
+
+/*
+ * Read the whole content of a file in a buffer which is grown when
+ * needed and kept across the calls, so reading periodically the same
+ * file does not allocate. The content is nul terminated. The files in
+ * debugfs and procfs do not give their size, they are read until EOF.
+ *
+ * @path : the file to be read
+ * @buf  : a pointer to the buffer, pointing to NULL the first time
+ * @size : a pointer to the size of the buffer
+ * Returns the number of bytes read on success, -1 otherwise
+ */
+ssize_t file_read_buffer(const char *path, char **buf, size_t *size)
+{
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	len = fd_read_buffer(fd, buf, size);
+
+	close(fd);
+
+	return len;
+}
+
+/*
+ * Open a file to be read periodically with fd_read_value, so it is not
+ * looked up in the filesystem at each read.
+ *
+ * @path : directory path containing the file
+ * @name : name of the file to be opened
+ * Returns the file descriptor on success, -1 otherwise
+ */
+int file_open_value(const char *path, const char *name)
+{
+	char *rpath;
+	int fd;
+
+	if (asprintf(&rpath, "%s/%s", path, name) < 0)
+		return -1;
+
+	fd = open(rpath, O_RDONLY | O_CLOEXEC);
+
+	free(rpath);
+
+	return fd;
+}
+
+/*
+ * Read an integer from a file opened with file_open_value. The sysfs
+ * attributes are generated at each read from the beginning of the file.
+ *
+ * @fd    : the file descriptor
+ * @value : a pointer to store the value
+ * Returns 0 on success, -1 otherwise
+ */
+int fd_read_value(int fd, long long *value)
+{
+	char buf[32], *end;
+	ssize_t len;
+
+	len = pread(fd, buf, sizeof(buf) - 1, 0);
+	if (len <= 0)
+		return -1;
+	buf[len] = '\0';
+
+	*value = strtoll(buf, &end, 10);
+	if (end == buf)
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Returns the current CLOCK_MONOTONIC time in microseconds, this is the
+ * time base used for any rate or interval computation as it does not
+ * jump when the wall clock is changed.
+ */
+uint64_t time_monotonic_us(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts))
+		return 0;
+
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+ * Raise the limit of open files to the hard limit, for the subsystems
+ * keeping thousands of attribute files opened.
+ *
+ * Returns the limit of open files, -1 if it is unknown
+ */
+long file_raise_nofile(void)
+{
+	struct rlimit rlim;
+
+	if (getrlimit(RLIMIT_NOFILE, &rlim))
+		return -1;
+
+	rlim.rlim_cur = rlim.rlim_max;
+
+	if (setrlimit(RLIMIT_NOFILE, &rlim) && getrlimit(RLIMIT_NOFILE, &rlim))
+		return -1;
+
+	return rlim.rlim_cur == RLIM_INFINITY ? LONG_MAX : (long)rlim.rlim_cur;
+}
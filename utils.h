@@ -15,10 +15,19 @@
 #ifndef __UTILS_H
 #define __UTILS_H
 
+#include <stdint.h>
+#include <sys/types.h>
+
 extern int file_read_value(const char *path, const char *name,
                            const char *format, void *value);
 extern int file_write_value(const char *path, const char *name,
 				const char *format, void *value);
+extern ssize_t file_read_buffer(const char *path, char **buf, size_t *size);
+extern ssize_t fd_read_buffer(int fd, char **buf, size_t *size);
+extern int file_open_value(const char *path, const char *name);
+extern int fd_read_value(int fd, long long *value);
+extern uint64_t time_monotonic_us(void);
+extern long file_raise_nofile(void);
 
 
 #endif
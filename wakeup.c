@@ -0,0 +1,491 @@
+/*******************************************************************************
+ * Copyright (C) 2010, Linaro Limited.
+ *
+ * This file is part of PowerDebug.
+ *
+ * All rights reserved. This program and the accompanying materials
+ * are made available under the terms of the Eclipse Public License v1.0
+ * which accompanies this distribution, and is available at
+ * http://www.eclipse.org/legal/epl-v10.html
+ *
+ *******************************************************************************/
+
+/*
+ * The wakeup sources ranked by their activity in the last interval. The
+ * debugfs wakeup_sources file is read through a held file descriptor
+ * and parsed in a single pass, each line being matched to its source
+ * with a hash on the name. The sources are allocated by blocks the
+ * first time they are seen, so a refresh does not allocate. Without
+ * debugfs, the attributes of /sys/class/wakeup are read through held
+ * file descriptors.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#undef _GNU_SOURCE
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "powerdebug.h"
+#include "display.h"
+#include "wakeup.h"
+#include "tree.h"
+#include "hash.h"
+#include "snapshot.h"
+#include "utils.h"
+
+#define DEBUGFS_WAKEUP "/sys/kernel/debug/wakeup_sources"
+#define SYSFS_WAKEUP "/sys/class/wakeup"
+
+#define WAKEUP_NAME_MAX 64
+#define WAKEUP_BLOCK 128
+
+enum wakeup_counter {
+	WAKEUP_EVENTS,
+	WAKEUP_WAKEUPS,
+	WAKEUP_TOTAL,
+	WAKEUP_COUNTER_MAX,
+};
+
+/* the attributes of /sys/class/wakeup, the total time is in ms */
+static const char *wakeup_attrs[] = {
+	[WAKEUP_EVENTS]  = "event_count",
+	[WAKEUP_WAKEUPS] = "wakeup_count",
+	[WAKEUP_TOTAL]   = "total_time_ms",
+};
+
+/*
+ * A wakeup source
+ *
+ * value : the event count, the wakeup count and the total active time
+ * delta : the differences with the previous refresh
+ * active: the source is active, active_since is not zero
+ * pass  : the last parse of the debugfs file listing the source
+ * fds   : the attributes of the sysfs source, -1 with debugfs
+ * fd_active : the active_time_ms attribute of the sysfs source
+ */
+struct wakeup_source {
+	char *name;
+	long long value[WAKEUP_COUNTER_MAX];
+	long long delta[WAKEUP_COUNTER_MAX];
+	bool active;
+	bool sampled;
+	unsigned int pass;
+	int fds[WAKEUP_COUNTER_MAX];
+	int fd_active;
+};
+
+static struct wakeup_source **wakeup_sources;
+static int wakeup_nrsources;
+static int wakeup_maxsources;
+
+/* the sources are given from the last allocated block */
+static struct wakeup_source *wakeup_block;
+static int wakeup_block_used = WAKEUP_BLOCK;
+
+/* the sources sorted by their activity in the last interval */
+static struct wakeup_source **wakeup_ranked;
+
+static struct hash *wakeup_hash;
+static struct tree *wakeup_tree;
+static int wakeup_fd = -1;
+static char *wakeup_buf;
+static size_t wakeup_size;
+static unsigned int wakeup_pass;
+static uint64_t wakeup_sampled;
+static uint64_t wakeup_interval;
+static bool wakeup_error = false;
+
+static const char * const wakeup_shape[] = { "wakeup*", NULL };
+
+static struct wakeup_source *wakeup_add(const char *name, size_t len)
+{
+	struct wakeup_source **sources, **ranked, *ws;
+	int i, max;
+
+	if (wakeup_nrsources == wakeup_maxsources) {
+
+		max = wakeup_maxsources ? wakeup_maxsources * 2 : WAKEUP_BLOCK;
+
+		sources = realloc(wakeup_sources, max * sizeof(*sources));
+		if (!sources)
+			return NULL;
+		wakeup_sources = sources;
+
+		ranked = realloc(wakeup_ranked, max * sizeof(*ranked));
+		if (!ranked)
+			return NULL;
+		wakeup_ranked = ranked;
+
+		wakeup_maxsources = max;
+	}
+
+	if (wakeup_block_used == WAKEUP_BLOCK) {
+		wakeup_block = calloc(WAKEUP_BLOCK, sizeof(*wakeup_block));
+		if (!wakeup_block)
+			return NULL;
+		wakeup_block_used = 0;
+	}
+
+	ws = &wakeup_block[wakeup_block_used];
+
+	/* the whole name is the key, a truncated one would never match */
+	ws->name = strndup(name, len);
+	if (!ws->name)
+		return NULL;
+
+	wakeup_block_used++;
+
+	for (i = 0; i < WAKEUP_COUNTER_MAX; i++)
+		ws->fds[i] = -1;
+	ws->fd_active = -1;
+
+	/* the name is not copied by the hash, it does not move */
+	if (hash_add_key(wakeup_hash, ws->name, len, ws))
+		return NULL;
+
+	wakeup_ranked[wakeup_nrsources] = ws;
+	wakeup_sources[wakeup_nrsources++] = ws;
+
+	return ws;
+}
+
+static void wakeup_update(struct wakeup_source *ws,
+			  long long value[WAKEUP_COUNTER_MAX])
+{
+	int i;
+
+	for (i = 0; i < WAKEUP_COUNTER_MAX; i++) {
+		ws->delta[i] = ws->sampled ? value[i] - ws->value[i] : 0;
+		ws->value[i] = value[i];
+	}
+
+	ws->sampled = true;
+}
+
+/*
+ * Parse the wakeup_sources content: a header line then a line per
+ * source with its name and, separated by tabs, the active, event,
+ * wakeup and expire counts, the active since, total, max and prevent
+ * suspend times in ms.
+ */
+static int wakeup_parse(char *buf)
+{
+	long long value[WAKEUP_COUNTER_MAX], since;
+	struct wakeup_source *ws;
+	char *p, *eol;
+	size_t len;
+	int i;
+
+	wakeup_pass++;
+
+	p = strchr(buf, '\n');
+
+	for (; p && *p; p = eol) {
+
+		p++;
+		eol = strchrnul(p, '\n');
+
+		len = strcspn(p, "\t");
+		if (p + len >= eol)
+			continue;
+
+		/* the name is padded with spaces to 12 characters */
+		while (len && p[len - 1] == ' ')
+			len--;
+		if (!len)
+			continue;
+
+		ws = hash_find(wakeup_hash, p, len);
+		if (!ws) {
+			ws = wakeup_add(p, len);
+			if (!ws)
+				return -1;
+		}
+
+		p += len;
+
+		strtoll(p, &p, 10);
+		value[WAKEUP_EVENTS] = strtoll(p, &p, 10);
+		value[WAKEUP_WAKEUPS] = strtoll(p, &p, 10);
+		strtoll(p, &p, 10);
+		since = strtoll(p, &p, 10);
+		value[WAKEUP_TOTAL] = strtoll(p, &p, 10);
+
+		ws->active = since != 0;
+		ws->pass = wakeup_pass;
+		wakeup_update(ws, value);
+	}
+
+	/* a source gone from the file had no activity */
+	for (i = 0; i < wakeup_nrsources; i++) {
+
+		ws = wakeup_sources[i];
+		if (ws->pass == wakeup_pass)
+			continue;
+
+		memset(ws->delta, 0, sizeof(ws->delta));
+		ws->active = false;
+		ws->sampled = false;
+	}
+
+	return 0;
+}
+
+static int read_wakeup_cb(struct tree *t, void *data)
+{
+	struct wakeup_source *ws = t->private;
+	long long value[WAKEUP_COUNTER_MAX], active;
+	int i;
+
+	if (!ws)
+		return 0;
+
+	for (i = 0; i < WAKEUP_COUNTER_MAX; i++)
+		if (ws->fds[i] < 0 || fd_read_value(ws->fds[i], &value[i]))
+			value[i] = ws->value[i];
+
+	if (ws->fd_active >= 0 && !fd_read_value(ws->fd_active, &active))
+		ws->active = active != 0;
+
+	wakeup_update(ws, value);
+
+	return 0;
+}
+
+static int wakeup_compare(const void *a, const void *b)
+{
+	const struct wakeup_source *wsa = *(struct wakeup_source * const *)a;
+	const struct wakeup_source *wsb = *(struct wakeup_source * const *)b;
+
+	if (wsa->delta[WAKEUP_WAKEUPS] != wsb->delta[WAKEUP_WAKEUPS])
+		return wsa->delta[WAKEUP_WAKEUPS] <
+			wsb->delta[WAKEUP_WAKEUPS] ? 1 : -1;
+
+	if (wsa->delta[WAKEUP_EVENTS] != wsb->delta[WAKEUP_EVENTS])
+		return wsa->delta[WAKEUP_EVENTS] <
+			wsb->delta[WAKEUP_EVENTS] ? 1 : -1;
+
+	if (wsa->delta[WAKEUP_TOTAL] != wsb->delta[WAKEUP_TOTAL])
+		return wsa->delta[WAKEUP_TOTAL] <
+			wsb->delta[WAKEUP_TOTAL] ? 1 : -1;
+
+	if (wsa->value[WAKEUP_WAKEUPS] != wsb->value[WAKEUP_WAKEUPS])
+		return wsa->value[WAKEUP_WAKEUPS] <
+			wsb->value[WAKEUP_WAKEUPS] ? 1 : -1;
+
+	return strcmp(wsa->name, wsb->name);
+}
+
+static int read_wakeup_info(void)
+{
+	uint64_t now = time_monotonic_us();
+
+	if (wakeup_fd >= 0) {
+		if (fd_read_buffer(wakeup_fd, &wakeup_buf, &wakeup_size) < 0)
+			return -1;
+		if (wakeup_parse(wakeup_buf))
+			return -1;
+	} else if (tree_for_each(wakeup_tree, read_wakeup_cb, NULL))
+		return -1;
+
+	wakeup_interval = wakeup_sampled ? now - wakeup_sampled : 0;
+	wakeup_sampled = now;
+
+	qsort(wakeup_ranked, wakeup_nrsources, sizeof(*wakeup_ranked),
+	      wakeup_compare);
+
+	return 0;
+}
+
+static inline double wakeup_percent(long long value, long long total)
+{
+	return total ? (double)value * 100 / total : 0;
+}
+
+static int wakeup_print_header(void)
+{
+	char *buf;
+	int ret;
+
+	if (asprintf(&buf, "%-40s %-10s %-10s %-10s %-10s %-14s", "Name",
+		     "Wakeups", "Events", "Active %", "State",
+		     "Total wakeups") < 0)
+		return -1;
+
+	ret = display_column_name(buf);
+
+	free(buf);
+
+	return ret;
+}
+
+static int wakeup_print_info(void)
+{
+	struct wakeup_source *ws;
+	char *buf;
+	int i, ret = 0;
+
+	display_reset_cursor(WAKEUP);
+
+	wakeup_print_header();
+
+	for (i = 0; i < wakeup_nrsources; i++) {
+
+		ws = wakeup_ranked[i];
+
+		if (asprintf(&buf, "%-40.63s %-10lld %-10lld %-10.1f %-10s %-14lld",
+			     ws->name, ws->delta[WAKEUP_WAKEUPS],
+			     ws->delta[WAKEUP_EVENTS],
+			     wakeup_percent(ws->delta[WAKEUP_TOTAL] * 1000,
+					    wakeup_interval),
+			     ws->active ? "active" : "",
+			     ws->value[WAKEUP_WAKEUPS]) < 0) {
+			ret = -1;
+			break;
+		}
+
+		display_print_line(WAKEUP, i, buf,
+				   ws->delta[WAKEUP_WAKEUPS] > 0, NULL);
+		free(buf);
+	}
+
+	display_refresh_pad(WAKEUP);
+
+	return ret;
+}
+
+static int wakeup_display(bool refresh)
+{
+	if (wakeup_error) {
+		display_message(WAKEUP,
+			"error: paths " DEBUGFS_WAKEUP " and " SYSFS_WAKEUP
+			" not found");
+		return -2;
+	}
+
+	if (refresh && read_wakeup_info())
+		return -1;
+
+	return wakeup_print_info();
+}
+
+int wakeup_dump(void)
+{
+	struct wakeup_source *ws;
+	int i;
+
+	printf("\nWakeup Sources:\n");
+	printf("***************\n");
+
+	if (read_wakeup_info())
+		return -1;
+
+	for (i = 0; i < wakeup_nrsources; i++) {
+		ws = wakeup_ranked[i];
+		printf("%s: events %lld, wakeups %lld, active %lld ms%s\n",
+		       ws->name, ws->value[WAKEUP_EVENTS],
+		       ws->value[WAKEUP_WAKEUPS], ws->value[WAKEUP_TOTAL],
+		       ws->active ? " (active)" : "");
+	}
+
+	return 0;
+}
+
+int wakeup_snapshot(struct snapshot *snap)
+{
+	struct wakeup_source *ws;
+	char *path;
+	int i, ret;
+
+	if (read_wakeup_info())
+		return -1;
+
+	for (i = 0; i < wakeup_nrsources; i++) {
+
+		ws = wakeup_sources[i];
+
+		if (asprintf(&path, "%s/%s", DEBUGFS_WAKEUP, ws->name) < 0)
+			return -1;
+
+		ret = snapshot_node(snap, path) ||
+			snapshot_int(snap, "wakeup_count",
+				     ws->value[WAKEUP_WAKEUPS]);
+
+		free(path);
+
+		if (ret)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int fill_wakeup_cb(struct tree *t, void *data)
+{
+	struct wakeup_source *ws;
+	char name[WAKEUP_NAME_MAX];
+	int i;
+
+	if (!t->parent)
+		return 0;
+
+	if (file_read_value(t->path, "name", "%63s", name))
+		return 0;
+
+	ws = wakeup_add(name, strlen(name));
+	if (!ws)
+		return -1;
+	t->private = ws;
+
+	for (i = 0; i < WAKEUP_COUNTER_MAX; i++)
+		ws->fds[i] = file_open_value(t->path, wakeup_attrs[i]);
+	ws->fd_active = file_open_value(t->path, "active_time_ms");
+
+	return 0;
+}
+
+static struct display_ops wakeup_ops = {
+	.display = wakeup_display,
+};
+
+int wakeup_init(void)
+{
+	int ret;
+
+	ret = display_register(WAKEUP, &wakeup_ops);
+	if (ret)
+		printf("error: wakeup display register failed");
+
+	wakeup_hash = hash_create(1024);
+	if (!wakeup_hash)
+		return -1;
+
+	wakeup_fd = open(DEBUGFS_WAKEUP, O_RDONLY | O_CLOEXEC);
+
+	if (wakeup_fd < 0) {
+
+		if (access(SYSFS_WAKEUP, F_OK)) {
+			wakeup_error = true; /* set the flag */
+			return -1;
+		}
+
+		wakeup_tree = tree_load_shape(SYSFS_WAKEUP, wakeup_shape, true);
+		if (!wakeup_tree)
+			return -1;
+
+		/* four files per source are kept opened */
+		file_raise_nofile();
+
+		if (tree_for_each(wakeup_tree, fill_wakeup_cb, NULL))
+			return -1;
+	}
+
+	if (read_wakeup_info())
+		return -1;
+
+	return ret;
+}